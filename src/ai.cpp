@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "ai.hpp"
+#include "wellsize.hpp"
+
+namespace {
+
+// The batch width follows the widest vectors the compiler is allowed
+// to use; GCC lowers the vector operations below to whatever the
+// target has.
+#if defined(__AVX2__)
+const int LANES = 8;
+#else
+const int LANES = 4;
+#endif
+
+typedef uint32_t Lanes __attribute__((vector_size(LANES * sizeof(uint32_t))));
+
+// Population count of every lane, by the usual bit-twiddling, since
+// there is no vector popcount instruction to rely on.
+inline Lanes popcount(Lanes x)
+{
+  x = x - ((x >> 1) & 0x55555555u);
+  x = (x & 0x33333333u) + ((x >> 2) & 0x33333333u);
+  x = (x + (x >> 4)) & 0x0f0f0f0fu;
+  x = x + (x >> 8);
+  x = x + (x >> 16);
+  return x & 0x3fu;
+}
+
+}
+
+const Evaluator::Weights Evaluator::DEFAULT_WEIGHTS = {
+  0.10,   // lines
+  -0.10,  // aggregate_height
+  -0.80,  // holes
+  -0.15,  // bumpiness
+  -0.30,  // row_transitions
+  -0.80,  // column_transitions
+  -0.20   // wells
+};
+
+void Board::load(const Game& game)
+{
+  width = game.getWidth();
+  height = game.getHeight();
+  assert(width <= 30 && height + 4 <= MAX_ROWS);
+  assert(game.getStoredRows() == height + 4);
+
+  const Game::RowMask* src = game.getRows();
+  std::copy(src, src + height + 4, rows);
+  std::fill(rows + height + 4, rows + MAX_ROWS, Game::RowMask(0));
+  hash = game.getBoardHash();
+}
+
+namespace {
+
+// Board::place() for boards of the given size.
+template<class Size>
+int placeOn(Size size, Board& board, const Piece& p, int x, int y)
+{
+  Game::RowMask* rows = board.rows;
+  uint64_t hash = board.hash;
+
+  for(int r = p.getTopMargin(); r < 4 - p.getBottomMargin(); ++r) {
+    hash ^= zobristRow(y-r, rows[y-r]);
+    rows[y-r] |= Game::pieceRowMask(p, r, x);
+    hash ^= zobristRow(y-r, rows[y-r]);
+  }
+
+  // Only the rows the piece landed in can have filled up, so if none
+  // of them did there is nothing to move.
+  const Game::RowMask full = (Game::RowMask(1) << size.width()) - 1;
+  const int top = size.rows();
+  int dst = y - (3 - p.getBottomMargin());
+  int last = y - p.getTopMargin();
+  int removed = 0;
+
+  for(int src = dst; src < top; ++src) {
+    if(src > last && removed == 0) {
+      board.hash = hash;
+      return 0;
+    }
+    if(rows[src] == full) {
+      hash ^= zobristRow(src, full);
+      ++removed;
+    } else {
+      if(removed > 0) {
+        hash ^= zobristRow(src, rows[src]) ^ zobristRow(dst, rows[src]);
+      }
+      rows[dst++] = rows[src];
+    }
+  }
+  std::fill(rows + dst, rows + top, Game::RowMask(0));
+
+  board.hash = hash;
+  return removed;
+}
+
+}
+
+int Board::place(const Piece& p, int x, int y)
+{
+  int removed = 0;
+  withWellSize(width, height, [&](auto size) {
+    removed = placeOn(size, *this, p, x, y);
+  });
+  return removed;
+}
+
+Evaluator::Evaluator()
+  : weights_(DEFAULT_WEIGHTS)
+{}
+
+Evaluator::Evaluator(const Weights& weights)
+  : weights_(weights)
+{}
+
+void Evaluator::evaluate(const Board* boards, const int* lines, int count,
+                         double* scores) const
+{
+  for(int first = 0; first < count; first += LANES) {
+    int n = std::min(LANES, count - first);
+    const Board* batch[ LANES ];
+    for(int k = 0; k < n; ++k) {
+      batch[k] = &boards[first + k];
+    }
+    evaluateBatch(batch, lines + first, n, scores + first);
+  }
+}
+
+void Evaluator::evaluate(const Board* const* boards, const int* lines,
+                         int count, double* scores) const
+{
+  for(int first = 0; first < count; first += LANES) {
+    int n = std::min(LANES, count - first);
+    evaluateBatch(boards + first, lines ? lines + first : NULL, n,
+                  scores + first);
+  }
+}
+
+void Evaluator::evaluateBatch(const Board* const* boards, const int* lines,
+                              int n, double* scores) const
+{
+  withWellSize(boards[0]->width, boards[0]->height, [&](auto size) {
+    evaluateBatch(size, boards, lines, n, scores);
+  });
+}
+
+template<class Size>
+void Evaluator::evaluateBatch(Size size, const Board* const* boards,
+                              const int* lines, int n, double* scores) const
+{
+  const int width = size.width();
+  const int top = size.rows();
+  const uint32_t full = (1u << width) - 1;
+  const uint32_t left_wall = 1u;
+  const uint32_t right_wall = 1u << (width - 1);
+  const uint32_t pair_mask = full >> 1;
+  const uint32_t edge_mask = (1u << (width + 1)) - 1;
+
+  // Rows above every board's stack add nothing to any feature, so
+  // start from the highest filled row in the batch.
+  int stack = 0;
+  for(int k = 0; k < n; ++k) {
+    const Game::RowMask* b = boards[k]->rows;
+    for(int r = top - 1; r >= stack; --r) {
+      if(b[r] != 0) {
+        stack = r + 1;
+        break;
+      }
+    }
+  }
+
+  // Transpose the batch so that each row is one vector, with a lane
+  // for each board.  Unused lanes just see an empty board.
+  uint32_t lanes[ Board::MAX_ROWS ][ LANES ] = {};
+  for(int k = 0; k < n; ++k) {
+    const Game::RowMask* b = boards[k]->rows;
+    for(int r = 0; r < stack; ++r) {
+      lanes[r][k] = b[r];
+    }
+  }
+  Lanes rows[ Board::MAX_ROWS ];
+  for(int r = 0; r < stack; ++r) {
+    std::memcpy(&rows[r], lanes[r], sizeof(Lanes));
+  }
+
+  Lanes zero = {};
+  Lanes seen = zero;
+  Lanes above = zero;
+  Lanes height = zero;
+  Lanes holes = zero;
+  Lanes bumpiness = zero;
+  Lanes wells = zero;
+  Lanes row_trans = zero;
+  Lanes col_trans = zero;
+
+  // Walk down from the top.  After row r has been folded into seen,
+  // a bit of seen is set exactly when that column is taller than r,
+  // which is enough to get heights and their differences without
+  // ever computing a column height.
+  for(int r = stack - 1; r >= 0; --r) {
+    Lanes row = rows[r];
+
+    holes += popcount(seen & ~row);
+    seen |= row;
+
+    height += popcount(seen);
+    bumpiness += popcount((seen ^ (seen >> 1)) & pair_mask);
+    wells += popcount(~seen & ((seen << 1) | left_wall) &
+                      ((seen >> 1) | right_wall) & full);
+
+    // Rows above the stack would each add two wall transitions.
+    Lanes edges = (row << 1) | 1u | (1u << (width + 1));
+    Lanes in_stack = (Lanes)(seen != 0);
+    row_trans += popcount((edges ^ (edges >> 1)) & edge_mask) & in_stack;
+
+    col_trans += popcount((row ^ above) & full);
+    above = row;
+  }
+  col_trans += popcount(~above & full);
+
+  for(int k = 0; k < n; ++k) {
+    scores[k] =
+      (lines ? weights_.lines * lines[k] : 0.0) +
+      weights_.aggregate_height * height[k] +
+      weights_.holes * holes[k] +
+      weights_.bumpiness * bumpiness[k] +
+      weights_.row_transitions * row_trans[k] +
+      weights_.column_transitions * col_trans[k] +
+      weights_.wells * wells[k];
+  }
+}
+
+AIPlayer::AIPlayer()
+{}
+
+AIPlayer::AIPlayer(const Evaluator::Weights& weights)
+  : evaluator_(weights)
+{}
+
+bool AIPlayer::choose(const Game& game, Placement& best)
+{
+  finder_.find(game.getRows(), game.getWidth(), game.getHeight(),
+               game.getPiece(), game.getPieceX(), game.getPieceY(),
+               placements_, PlacementFinder::DROP_ONLY);
+
+  int count = placements_.size();
+  if(count == 0) {
+    return false;
+  }
+
+  Board board;
+  board.load(game);
+
+  boards_.resize(count);
+  lines_.resize(count);
+  scores_.resize(count);
+  for(int i = 0; i < count; ++i) {
+    const Placement& p = placements_[i];
+    boards_[i] = board;
+    lines_[i] = boards_[i].place(Piece(game.getPiece().getId(), p.rotation),
+                                 p.x, p.y);
+  }
+
+  evaluator_.evaluate(&boards_[0], &lines_[0], count, &scores_[0]);
+
+  best = placements_[ std::max_element(scores_.begin(), scores_.end()) -
+                      scores_.begin() ];
+  return true;
+}
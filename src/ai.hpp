@@ -0,0 +1,109 @@
+#ifndef CS488_AI_HPP
+#define CS488_AI_HPP
+
+#include <vector>
+
+#include "game.hpp"
+#include "placement.hpp"
+
+// The locked cells of a well as a plain value: one occupancy word per
+// row, for the well and the four rows above it.  Boards never allocate,
+// so they can be copied and scored freely.
+struct Board
+{
+  static const int MAX_ROWS = 32;
+
+  int width;
+  int height;
+  Game::RowMask rows[ MAX_ROWS ];
+  // The same Zobrist hash of the locked cells as Game::getBoardHash(),
+  // kept up to date by place().
+  uint64_t hash;
+
+  // Copy the locked cells of a game.  The well must be no more than 30
+  // columns wide and MAX_ROWS - 4 rows high.
+  void load(const Game& game);
+
+  // Lock a piece in at (x,y) and remove any rows it fills, as the game
+  // would.  Returns the number of rows removed.
+  int place(const Piece& p, int x, int y);
+};
+
+// Scores boards by a weighted sum of the usual hand-picked features.
+// Boards are scored in batches, a SIMD lane per board, so all of the
+// candidates for one piece are handled in a single pass.
+class Evaluator
+{
+public:
+  // Each feature's weight; higher scores are better.  The features are
+  // the rows just cleared, the sum of the column heights, the empty
+  // cells with a filled cell somewhere above them, the sum of height
+  // differences between neighbouring columns, the filled/empty changes
+  // along each row and down each column (the walls and floor count as
+  // filled), and the cells at the bottom of wells: empty cells with
+  // both neighbours filled.
+  struct Weights
+  {
+    double lines;
+    double aggregate_height;
+    double holes;
+    double bumpiness;
+    double row_transitions;
+    double column_transitions;
+    double wells;
+  };
+
+  static const Weights DEFAULT_WEIGHTS;
+
+  Evaluator();
+  explicit Evaluator(const Weights& weights);
+
+  const Weights& getWeights() const
+  {
+    return weights_;
+  }
+
+  // Score count boards, where lines[i] rows were cleared on the way to
+  // boards[i].  All of the boards must have the same dimensions.
+  void evaluate(const Board* boards, const int* lines, int count,
+                double* scores) const;
+
+  // The same, for boards scattered about memory.  If lines is NULL the
+  // scores leave out the lines term, and depend only on the boards.
+  void evaluate(const Board* const* boards, const int* lines, int count,
+                double* scores) const;
+
+private:
+  // Score up to one batch of boards, with the kernel compiled for
+  // their size.
+  void evaluateBatch(const Board* const* boards, const int* lines, int n,
+                     double* scores) const;
+  template<class Size>
+  void evaluateBatch(Size size, const Board* const* boards,
+                     const int* lines, int n, double* scores) const;
+
+  Weights weights_;
+};
+
+// Plays by trying every placement of the falling piece and taking the
+// one whose resulting board scores best.
+class AIPlayer
+{
+public:
+  AIPlayer();
+  explicit AIPlayer(const Evaluator::Weights& weights);
+
+  // Pick the best placement for the falling piece.  Returns false if
+  // the piece has nowhere to go.
+  bool choose(const Game& game, Placement& best);
+
+private:
+  Evaluator evaluator_;
+  PlacementFinder finder_;
+  std::vector<Placement> placements_;
+  std::vector<Board> boards_;
+  std::vector<int> lines_;
+  std::vector<double> scores_;
+};
+
+#endif // CS488_AI_HPP
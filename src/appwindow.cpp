@@ -2,7 +2,7 @@
 
 #include <iostream>
 
-AppWindow::AppWindow()
+AppWindow::AppWindow( const char* record_path )
 {
 	set_title( "488 Tetrominoes on the Wall" );
 
@@ -20,6 +20,9 @@ AppWindow::AppWindow()
 			sigc::mem_fun( m_viewer, &Viewer::newGame )) );
 	m_menu_file.items().push_back( MenuElem("_Reset", Gtk::AccelKey( "r" ),
 			sigc::mem_fun( m_viewer, &Viewer::reset )) );
+	m_menu_file.items().push_back( CheckMenuElem("_Autoplay",
+			Gtk::AccelKey( "a" ),
+			sigc::mem_fun( m_viewer, &Viewer::toggle_autoplay )) );
 	m_menu_file.items().push_back( MenuElem("_Quit", Gtk::AccelKey( "q" ),
 			sigc::mem_fun( *this, &AppWindow::hide )) );
 
@@ -56,6 +59,24 @@ AppWindow::AppWindow()
 			Gtk::AccelKey( "b" ),
 			sigc::mem_fun( m_viewer, &Viewer::swap_buffermode )) );
 
+	// Set up the Frame Rate menu, which caps how often the viewer
+	// redraws; unlimited draws every frame that is asked for
+	Gtk::RadioButtonGroup m_framerategroup;
+	sigc::slot1<void, int> framerate_slot =
+			sigc::mem_fun( m_viewer, &Viewer::set_frame_rate );
+	m_menu_frame_rate.items().push_back( RadioMenuElem(m_framerategroup,
+			"_30 per second",
+			sigc::bind( framerate_slot, 30 )) );
+	m_menu_frame_rate.items().push_back( RadioMenuElem(m_framerategroup,
+			"_60 per second",
+			sigc::bind( framerate_slot, 60 )) );
+	m_menu_frame_rate.items().push_back( RadioMenuElem(m_framerategroup,
+			"_120 per second",
+			sigc::bind( framerate_slot, 120 )) );
+	m_menu_frame_rate.items().push_back( RadioMenuElem(m_framerategroup,
+			"_Unlimited",
+			sigc::bind( framerate_slot, 0 )) );
+
 	// Set up the menu bar
 	m_menubar.items().push_back( Gtk::Menu_Helpers::MenuElem("_File",
 			m_menu_file) );
@@ -65,6 +86,8 @@ AppWindow::AppWindow()
 			m_menu_speed) );
 	m_menubar.items().push_back( Gtk::Menu_Helpers::MenuElem("_Buffering",
 			m_menu_buffering) );
+	m_menubar.items().push_back( Gtk::Menu_Helpers::MenuElem("Frame _Rate",
+			m_menu_frame_rate) );
 
 	// Pack in our widgets
 	// First add the vertical box as our single "top" widget
@@ -83,8 +106,17 @@ AppWindow::AppWindow()
 	// Set double buffering to default
 	static_cast<CheckMenuItem*>( &m_menu_buffering.items()[0] )->set_active();
 
+	// Start at the viewer's own frame rate
+	static_cast<Gtk::RadioMenuItem*>(
+			&m_menu_frame_rate.items()[1] )->set_active();
+
 	// Set the pointer to the window object so we can communicate back
 	m_viewer.set_window(this);
+
+	if ( record_path != NULL && !m_viewer.set_record_file( record_path ) )
+	{
+		std::cerr << "Unable to record to " << record_path << std::endl;
+	}
 }
 
 bool AppWindow::on_key_press_event( GdkEventKey *ev )
@@ -93,7 +125,9 @@ bool AppWindow::on_key_press_event( GdkEventKey *ev )
 	{
 	case 65505: // Shift
 		m_viewer.set_key( ev->keyval );
+		m_viewer.invalidate();
 		break;
+	// The viewer rerenders for moves itself, only when one succeeds
 	case 65361: // Left
 		m_viewer.moveLeft();
 		break;
@@ -113,8 +147,6 @@ bool AppWindow::on_key_press_event( GdkEventKey *ev )
         return Gtk::Window::on_key_press_event( ev );
 	}
 
-	m_viewer.invalidate();
-
     return true;
 }
 
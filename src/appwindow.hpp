@@ -7,7 +7,8 @@
 
 class AppWindow : public Gtk::Window {
 public:
-	AppWindow();
+	// If record_path is given, every game played is recorded there
+	AppWindow( const char* record_path = NULL );
 
 	// Updates the speed menu radio buttons
 	void update_speed  ( int speed );
@@ -29,6 +30,7 @@ private:
 	Gtk::Menu    m_menu_draw_mode;
 	Gtk::Menu    m_menu_speed;
 	Gtk::Menu    m_menu_buffering;
+	Gtk::Menu    m_menu_frame_rate;
 
 	// The main OpenGL area
 	Viewer       m_viewer;
@@ -0,0 +1,905 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "game.hpp"
+
+// Micro-benchmarks of the engine.  Each benchmark is run on every well
+// size given, with the well filled to each of the densities given, and
+// reports the time and the cycles per operation, both as a table and,
+// with -j, as JSON to compare against other builds.
+//
+// A well is filled by a greedy filler that keeps the surface flat and
+// leaves the last column open, so that no rows clear while it works.
+// The fill is the height of the stack as a fraction of the well's,
+// and is reported as it actually came out.  The clear benchmark's
+// well is filled until the rows the straight piece would land in, at
+// the bottom of the open column, are full everywhere else, so that it
+// always clears four rows with the rest of the stack above them.
+// Operations are timed in batches, on copies of the filled game made
+// before the clock starts, so only the operations themselves are
+// counted.
+//
+// Cycles are read from the time stamp counter, which ticks at a fixed
+// rate whatever the clock speed of the core, and are only reported on
+// x86.
+//
+// The play benchmark measures how the cost of locking pieces in and
+// clearing rows grows with the size of the well.  It plays games with
+// the filler from an empty well, so it runs once for each size, not
+// for each fill; with a large height it checks that the cost stays
+// flat with height, and stored gives the most rows the game ever kept
+// in memory.
+
+static void usage(const char* prog)
+{
+  std::fprintf(stderr,
+      "usage: %s [-w WIDTHxHEIGHT,...] [-f fill,...] [-n ops] "
+      "[-s seed] [-j file] [benchmark...]\n"
+      "benchmarks: tick lock clear move rotate drop fits piece play\n",
+      prog);
+}
+
+static double nanos()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static const bool HAVE_CYCLES = true;
+static uint64_t cycles()
+{
+  return __rdtsc();
+}
+#else
+static const bool HAVE_CYCLES = false;
+static uint64_t cycles()
+{
+  return 0;
+}
+#endif
+
+// Results are summed into this, so that the compiler can't throw away
+// the work that produced them.
+static volatile long sink;
+
+// Picks, for each piece, the orientation and column that leave the
+// fewest empty cells beneath it, and of those the lowest, keeping the
+// piece out of the last open columns of the well.
+class FlatFiller
+{
+public:
+  explicit FlatFiller(int open = 0)
+    : open_(open)
+  {}
+
+  void play(Game& game)
+  {
+    loadHeights(game);
+
+    int id = game.getPiece().getId();
+    int best_rotation = 0;
+    int best_x = game.getPieceX();
+    long best_score = -1;
+
+    for(int rotation = 0; rotation < NUM_ROTATIONS; ++rotation) {
+      Piece p(id, rotation);
+      for(int x = -p.getLeftMargin();
+          x + 3 - p.getRightMargin() < game.getWidth() - open_; ++x) {
+        // The piece comes to rest on the tallest column beneath it.
+        int y = 0;
+        for(int c = p.getLeftMargin(); c < 4 - p.getRightMargin(); ++c) {
+          y = std::max(y, heights_[x+c] + p.getColumnBottom(c));
+        }
+        long gaps = 0;
+        for(int c = p.getLeftMargin(); c < 4 - p.getRightMargin(); ++c) {
+          gaps += y - p.getColumnBottom(c) - heights_[x+c];
+        }
+
+        long score = gaps * 1024 + y;
+        if(best_score < 0 || score < best_score) {
+          best_score = score;
+          best_rotation = rotation;
+          best_x = x;
+        }
+      }
+    }
+
+    for(int i = 0; i < best_rotation; ++i) {
+      game.rotateCW();
+    }
+    while(game.getPieceX() > best_x && game.moveLeft()) {
+    }
+    while(game.getPieceX() < best_x && game.moveRight()) {
+    }
+    game.drop();
+  }
+
+  // The height of the game's stack.
+  int stackHeight(const Game& game)
+  {
+    loadHeights(game);
+    return *std::max_element(heights_.begin(), heights_.end());
+  }
+
+private:
+  void loadHeights(const Game& game)
+  {
+    int width = game.getWidth();
+    int words = game.getRowWords();
+
+    heights_.assign(width, 0);
+    seen_.assign(words, 0);
+    for(int r = game.getStoredRows() - 1; r >= 0; --r) {
+      const Game::RowMask* row = game.getRow(r);
+      for(int k = 0; k < words; ++k) {
+        Game::RowMask fresh = row[k] & ~seen_[k];
+        for(; fresh != 0; fresh &= fresh - 1) {
+          heights_[ k*64 + __builtin_ctzll(fresh) ] = r + 1;
+        }
+        seen_[k] |= row[k];
+      }
+    }
+  }
+
+  int open_;
+  std::vector<int> heights_;
+  std::vector<Game::RowMask> seen_;
+};
+
+// The piece that is four cells in a line.
+static int straightPiece()
+{
+  for(int id = 0; id < NUM_PIECES; ++id) {
+    for(int r = 0; r < 4; ++r) {
+      if(Piece(id, 0).getRowMask(r) == 0xf) {
+        return id;
+      }
+    }
+  }
+  return 0;
+}
+
+static bool upright(const Piece& p)
+{
+  return p.getLeftMargin() + p.getRightMargin() == 3;
+}
+
+// Stand the falling straight piece on end and drop it into the last
+// column.
+static void dropInOpenColumn(Game& game)
+{
+  for(int i = 0; i < NUM_ROTATIONS && !upright(game.getPiece()); ++i) {
+    game.rotateCW();
+  }
+  while(game.moveRight()) {
+  }
+  game.drop();
+}
+
+// How many rows the straight piece clears when dropped into the open
+// column of a clear fixture, and how many seeds to try filling it from.
+static const int CLEAR_ROWS = 4;
+static const int CLEAR_TRIES = 16;
+
+// The height of the stack in the open column.
+static int openHeight(const Game& game)
+{
+  int r = 0;
+  while(game.getLocked(r, game.getWidth() - 1) >= 0) {
+    ++r;
+  }
+  return r;
+}
+
+// Whether the CLEAR_ROWS rows from base up are full but for the open
+// column.
+static bool clearable(const Game& game, int base)
+{
+  for(int r = base; r < base + CLEAR_ROWS; ++r) {
+    for(int c = 0; c < game.getWidth() - 1; ++c) {
+      if(game.getLocked(r, c) < 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Whether any of the CLEAR_ROWS rows from base up has an empty cell
+// with a filled one above it, which can never be filled.
+static bool holed(const Game& game, int base)
+{
+  for(int c = 0; c < game.getWidth() - 1; ++c) {
+    int top = game.getStoredRows() - 1;
+    while(top >= 0 && game.getLocked(top, c) < 0) {
+      --top;
+    }
+    for(int r = base; r < base + CLEAR_ROWS && r < top; ++r) {
+      if(game.getLocked(r, c) < 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Play until the straight piece is falling, and the CLEAR_ROWS rows at
+// the bottom of the open column are full everywhere else.  Of the
+// times that happens, stop at the one that leaves the stack nearest the
+// target height.  The first rows the filler lays on the floor often
+// have holes, which no piece can reach, so while the rows the straight
+// piece would land in have one, it goes into the open column, to land
+// higher up next time.  Returns false if the stack reaches limit first.
+static bool fillToClear(Game& game, FlatFiller& filler, int target,
+                        int limit)
+{
+  Game below(game);
+  bool have_below = false;
+
+  int height;
+  while((height = filler.stackHeight(game)) < limit) {
+    if(game.getPiece().getId() == straightPiece()) {
+      int base = openHeight(game);
+      if(clearable(game, base)) {
+        if(height >= target) {
+          if(have_below &&
+             target - filler.stackHeight(below) < height - target) {
+            game = below;
+          }
+          return true;
+        }
+        below = game;
+        have_below = true;
+      } else if(holed(game, base)) {
+        dropInOpenColumn(game);
+        game.tick();
+        continue;
+      }
+    }
+    filler.play(game);
+    game.tick();
+  }
+  return false;
+}
+
+// A game filled to a given density, with the falling piece waiting at
+// the top, for the benchmarks to copy.
+struct Fixture
+{
+  Fixture(int width, int height, double fill, unsigned seed,
+          bool straight)
+    : game(width, height)
+    , falls(0)
+  {
+    start(game, seed);
+
+    // Leave room for a piece to fall in.
+    int target = std::min(int(std::floor(fill * height + 0.5)),
+                          height - 8);
+
+    FlatFiller filler(1);
+    if(straight) {
+      // How near the stack comes to the target depends on where the
+      // holes fall, so keep whichever seed comes nearest.
+      int best = -1;
+      for(int i = 0; i < CLEAR_TRIES && best != target; ++i) {
+        Game trial(width, height);
+        start(trial, seed + i);
+        if(!fillToClear(trial, filler, target, height - 4)) {
+          continue;
+        }
+        int stack = filler.stackHeight(trial);
+        if(best < 0 || std::abs(stack - target) < std::abs(best - target)) {
+          game = trial;
+          best = stack;
+        }
+      }
+    } else {
+      while(filler.stackHeight(game) < target) {
+        filler.play(game);
+        game.tick();
+      }
+    }
+
+    actual = double(filler.stackHeight(game)) / height;
+
+    Game dropped(game);
+    dropped.drop();
+    falls = game.getPieceY() - dropped.getPieceY();
+  }
+
+  Game game;
+  double actual;
+  // How many ticks the falling piece takes to land.
+  int falls;
+
+private:
+  static void start(Game& game, unsigned seed)
+  {
+    game.seed(seed);
+    game.setRandomizer(Game::BAG);
+    game.reset();
+  }
+};
+
+struct Result
+{
+  std::string name;
+  int width;
+  int height;
+  double fill;
+  long ops;
+  double ns;
+  double cycles;
+  // Anything else a benchmark measures, by name.
+  std::vector<std::pair<std::string, double> > extra;
+};
+
+// A benchmark prepares each copy of the fixture, then runs on it and
+// says how many operations it did.
+class Benchmark
+{
+public:
+  virtual ~Benchmark()
+  {}
+
+  virtual const char* name() const = 0;
+  // The benchmark needs the straight piece to fall first.
+  virtual bool straight() const
+  {
+    return false;
+  }
+  virtual void prepare(const Fixture&, Game&)
+  {}
+  virtual int run(const Fixture& fixture, Game& game) = 0;
+  // Add anything else measured to the result, and start over.
+  virtual void finish(Result&)
+  {}
+};
+
+// Ticks that move the falling piece down a row.
+class TickBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "tick";
+  }
+  int run(const Fixture& fixture, Game& game)
+  {
+    for(int i = 0; i < fixture.falls; ++i) {
+      sink += game.tick();
+    }
+    return fixture.falls;
+  }
+};
+
+// Ticks that lock a piece in without clearing anything.
+class LockBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "lock";
+  }
+  void prepare(const Fixture&, Game& game)
+  {
+    game.drop();
+  }
+  int run(const Fixture&, Game& game)
+  {
+    sink += game.tick();
+    return 1;
+  }
+};
+
+// Ticks that lock the straight piece upright into the open column,
+// clearing the CLEAR_ROWS rows the fixture filled beside it, which
+// brings every row above them down.  The rows cleared per tick come out
+// as rows.  If the fixture couldn't be filled that way there is no
+// result.
+class ClearBenchmark : public Benchmark
+{
+public:
+  ClearBenchmark()
+    : ticks_(0)
+    , rows_(0)
+  {}
+
+  const char* name() const
+  {
+    return "clear";
+  }
+  bool straight() const
+  {
+    return true;
+  }
+  void prepare(const Fixture&, Game& game)
+  {
+    dropInOpenColumn(game);
+  }
+  int run(const Fixture&, Game& game)
+  {
+    int rows = game.tick();
+    if(rows <= 0) {
+      return 0;
+    }
+    ++ticks_;
+    rows_ += rows;
+    sink += rows;
+    return 1;
+  }
+  void finish(Result& result)
+  {
+    result.extra.push_back(std::make_pair("rows", double(rows_) / ticks_));
+    ticks_ = 0;
+    rows_ = 0;
+  }
+
+private:
+  long ticks_;
+  long rows_;
+};
+
+class MoveBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "move";
+  }
+  int run(const Fixture&, Game& game)
+  {
+    for(int i = 0; i < 4; ++i) {
+      sink += game.moveLeft();
+      sink += game.moveLeft();
+      sink += game.moveRight();
+      sink += game.moveRight();
+    }
+    return 16;
+  }
+};
+
+class RotateBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "rotate";
+  }
+  int run(const Fixture&, Game& game)
+  {
+    for(int i = 0; i < 4; ++i) {
+      sink += game.rotateCW();
+      sink += game.rotateCW();
+      sink += game.rotateCCW();
+      sink += game.rotateCCW();
+    }
+    return 16;
+  }
+};
+
+class DropBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "drop";
+  }
+  int run(const Fixture&, Game& game)
+  {
+    sink += game.drop();
+    return 1;
+  }
+};
+
+// Game::pieceFits() for the falling piece in every orientation, across
+// the well and down to the top of the stack: the test the placement
+// search makes.  Only wells stored whole and a word wide are searched.
+class FitsBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "fits";
+  }
+  int run(const Fixture& fixture, Game& game)
+  {
+    if(game.getRowWords() != 1 ||
+       game.getStoredRows() != game.getHeight() + 4) {
+      return 0;
+    }
+
+    const Game::RowMask* rows = game.getRows();
+    int width = game.getWidth();
+    int top = game.getPieceY();
+    int ops = 0;
+    long fits = 0;
+    for(int rotation = 0; rotation < NUM_ROTATIONS; ++rotation) {
+      Piece p(game.getPiece().getId(), rotation);
+      for(int x = -1; x < width - 2; ++x) {
+        for(int y = top; y > top - fixture.falls - 2; --y) {
+          fits += Game::pieceFits(rows, width, p, x, y);
+          ++ops;
+        }
+      }
+    }
+    sink += fits;
+    return ops;
+  }
+};
+
+// Turning a Piece through every orientation, both ways.
+class PieceBenchmark : public Benchmark
+{
+public:
+  const char* name() const
+  {
+    return "piece";
+  }
+  int run(const Fixture&, Game& game)
+  {
+    unsigned masks = 0;
+    for(int id = 0; id < NUM_PIECES; ++id) {
+      Piece p(id, game.getPiece().getRotation());
+      for(int i = 0; i < NUM_ROTATIONS; ++i) {
+        p = p.rotateCW();
+        masks += p.getRowMask(1);
+      }
+      for(int i = 0; i < NUM_ROTATIONS; ++i) {
+        p = p.rotateCCW();
+        masks += p.getRowMask(2);
+      }
+    }
+    sink += masks;
+    return NUM_PIECES * NUM_ROTATIONS * 2;
+  }
+};
+
+// Games are copied and prepared this many at a time, and then the
+// whole batch is timed at once.
+static const int BATCH = 64;
+
+static Result measure(Benchmark& bench, const Fixture& fixture, long ops)
+{
+  Result result;
+  result.name = bench.name();
+  result.width = fixture.game.getWidth();
+  result.height = fixture.game.getHeight();
+  result.fill = fixture.actual;
+  result.ops = 0;
+  result.ns = 0;
+  result.cycles = 0;
+
+  std::vector<Game> games(BATCH, fixture.game);
+
+  // The first batch warms the caches, and isn't counted.
+  for(bool warm = true; warm || result.ops < ops; warm = false) {
+    for(int i = 0; i < BATCH; ++i) {
+      games[i] = fixture.game;
+      bench.prepare(fixture, games[i]);
+    }
+
+    double start = nanos();
+    uint64_t start_cycles = cycles();
+    long done = 0;
+    for(int i = 0; i < BATCH; ++i) {
+      done += bench.run(fixture, games[i]);
+    }
+    uint64_t end_cycles = cycles();
+    double end = nanos();
+
+    if(done == 0) {
+      break;
+    }
+    if(!warm) {
+      result.ops += done;
+      result.ns += end - start;
+      result.cycles += end_cycles - start_cycles;
+    }
+  }
+
+  bench.finish(result);
+  return result;
+}
+
+// Plays games from an empty well, timing every tick that locks a
+// piece in.
+static Result play(int width, int height, unsigned seed, long pieces)
+{
+  Game game(width, height);
+  FlatFiller filler;
+  game.seed(seed);
+  game.reset();
+
+  long games = 1;
+  int stored = 0;
+  long locks = 0;
+  long clears = 0;
+  long lines = 0;
+  double lock_time = 0;
+  double clear_time = 0;
+  uint64_t total_cycles = 0;
+
+  for(long n = 0; n < pieces; ++n) {
+    filler.play(game);
+
+    // The piece has landed, so this tick locks it in.
+    double start = nanos();
+    uint64_t start_cycles = cycles();
+    int rows = game.tick();
+    total_cycles += cycles() - start_cycles;
+    double elapsed = nanos() - start;
+
+    if(rows > 0) {
+      ++clears;
+      lines += rows;
+      clear_time += elapsed;
+    } else {
+      ++locks;
+      lock_time += elapsed;
+    }
+    stored = std::max(stored, game.getStoredRows());
+    if(rows < 0) {
+      ++games;
+      game.reset();
+    }
+  }
+
+  Result result;
+  result.name = "play";
+  result.width = width;
+  result.height = height;
+  result.fill = 0;
+  result.ops = pieces;
+  result.ns = lock_time + clear_time;
+  result.cycles = total_cycles;
+  result.extra.push_back(std::make_pair("games", games));
+  result.extra.push_back(std::make_pair("lines", lines));
+  result.extra.push_back(std::make_pair("ns_per_lock",
+                                        locks ? lock_time / locks : 0.0));
+  result.extra.push_back(std::make_pair("ns_per_clear",
+                                        clears ? clear_time / clears : 0.0));
+  result.extra.push_back(std::make_pair("ns_per_row",
+                                        lines ? clear_time / lines : 0.0));
+  result.extra.push_back(std::make_pair("stored", stored));
+  return result;
+}
+
+static void printResult(const Result& r)
+{
+  std::printf("%-7s %6d %6d %5.2f %10.1f %14.0f", r.name.c_str(), r.width,
+              r.height, r.fill, r.ns / r.ops, r.ops / (r.ns * 1e-9));
+  if(HAVE_CYCLES) {
+    std::printf(" %10.1f", r.cycles / r.ops);
+  } else {
+    std::printf(" %10s", "-");
+  }
+  for(size_t i = 0; i < r.extra.size(); ++i) {
+    std::printf(" %s=%g", r.extra[i].first.c_str(), r.extra[i].second);
+  }
+  std::printf("\n");
+}
+
+static bool writeJson(const char* path, const std::vector<Result>& results,
+                      unsigned seed)
+{
+  FILE* file = std::fopen(path, "w");
+  if(file == NULL) {
+    return false;
+  }
+
+  std::fprintf(file, "{\n  \"seed\": %u,\n  \"cycles\": %s,\n"
+               "  \"results\": [", seed, HAVE_CYCLES ? "true" : "false");
+  for(size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::fprintf(file, "%s\n    {\"benchmark\": \"%s\", \"width\": %d, "
+                 "\"height\": %d, \"fill\": %.4f, \"ops\": %ld, "
+                 "\"ns_per_op\": %.3f, \"ops_per_sec\": %.1f, "
+                 "\"cycles_per_op\": ", i ? "," : "", r.name.c_str(),
+                 r.width, r.height, r.fill, r.ops, r.ns / r.ops,
+                 r.ops / (r.ns * 1e-9));
+    if(HAVE_CYCLES) {
+      std::fprintf(file, "%.3f", r.cycles / r.ops);
+    } else {
+      std::fprintf(file, "null");
+    }
+    for(size_t k = 0; k < r.extra.size(); ++k) {
+      std::fprintf(file, ", \"%s\": %.17g", r.extra[k].first.c_str(),
+                   r.extra[k].second);
+    }
+    std::fprintf(file, "}");
+  }
+  std::fprintf(file, "\n  ]\n}\n");
+
+  return std::fclose(file) == 0;
+}
+
+// Wells bigger than this are surely a mistake.
+static const long MAX_SIZE = 1 << 24;
+
+// Parse a comma-separated list of sizes such as "10x20,64x64".
+static bool parseSizes(const char* arg, std::vector<std::pair<int, int> >& out)
+{
+  out.clear();
+  const char* p = arg;
+  for(;;) {
+    char* end;
+    long width = std::strtol(p, &end, 10);
+    if(end == p || *end != 'x') {
+      return false;
+    }
+    p = end + 1;
+    long height = std::strtol(p, &end, 10);
+    if(end == p || width < 6 || width > MAX_SIZE ||
+       height < 12 || height > MAX_SIZE) {
+      return false;
+    }
+    out.push_back(std::make_pair(int(width), int(height)));
+    if(*end == '\0') {
+      return true;
+    }
+    if(*end != ',') {
+      return false;
+    }
+    p = end + 1;
+  }
+}
+
+static bool parseFills(const char* arg, std::vector<double>& out)
+{
+  out.clear();
+  const char* p = arg;
+  for(;;) {
+    char* end;
+    double fill = std::strtod(p, &end);
+    if(end == p || !(fill >= 0 && fill <= 1)) {
+      return false;
+    }
+    out.push_back(fill);
+    if(*end == '\0') {
+      return true;
+    }
+    if(*end != ',') {
+      return false;
+    }
+    p = end + 1;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<std::pair<int, int> > sizes;
+  std::vector<double> fills;
+  long ops = 200000;
+  unsigned seed = 1;
+  const char* json = NULL;
+
+  parseSizes("10x20,10x22,32x64,256x256", sizes);
+  parseFills("0,0.25,0.5", fills);
+
+  int opt;
+  while((opt = getopt(argc, argv, "w:f:n:s:j:")) != -1) {
+    switch(opt) {
+    case 'w':
+      if(!parseSizes(optarg, sizes)) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'f':
+      if(!parseFills(optarg, fills)) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'n': ops = std::atol(optarg); break;
+    case 's': seed = std::strtoul(optarg, NULL, 0); break;
+    case 'j': json = optarg; break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  TickBenchmark tick;
+  LockBenchmark lock;
+  ClearBenchmark clear;
+  MoveBenchmark move;
+  RotateBenchmark rotate;
+  DropBenchmark drop;
+  FitsBenchmark fits;
+  PieceBenchmark piece;
+  Benchmark* all[] = { &tick, &lock, &clear, &move, &rotate, &drop, &fits,
+                       &piece };
+  const int count = sizeof(all) / sizeof(all[0]);
+
+  std::vector<Benchmark*> chosen;
+  bool with_play = optind == argc;
+  for(int i = optind; i < argc; ++i) {
+    if(std::strcmp(argv[i], "play") == 0) {
+      with_play = true;
+      continue;
+    }
+    Benchmark* found = NULL;
+    for(int k = 0; k < count; ++k) {
+      if(std::strcmp(argv[i], all[k]->name()) == 0) {
+        found = all[k];
+      }
+    }
+    if(found == NULL) {
+      usage(argv[0]);
+      return 1;
+    }
+    chosen.push_back(found);
+  }
+  if(optind == argc) {
+    chosen.assign(all, all + count);
+  }
+
+  if(ops <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::printf("%-7s %6s %6s %5s %10s %14s %10s\n", "bench", "width",
+              "height", "fill", "ns/op", "ops/sec", "cycles/op");
+
+  std::vector<Result> results;
+  for(size_t s = 0; s < sizes.size(); ++s) {
+    int width = sizes[s].first;
+    int height = sizes[s].second;
+
+    for(size_t f = 0; f < fills.size(); ++f) {
+      // Filling a well for the straight piece plays whole games, so
+      // each kind of fixture is only built if a benchmark wants it.
+      Fixture* fixtures[2] = { NULL, NULL };
+
+      for(size_t b = 0; b < chosen.size(); ++b) {
+        Benchmark& bench = *chosen[b];
+        bool straight = bench.straight();
+        if(fixtures[straight] == NULL) {
+          fixtures[straight] = new Fixture(width, height, fills[f], seed,
+                                           straight);
+        }
+        Result r = measure(bench, *fixtures[straight], ops);
+        if(r.ops == 0) {
+          continue;
+        }
+        printResult(r);
+        results.push_back(r);
+      }
+
+      delete fixtures[0];
+      delete fixtures[1];
+    }
+
+    if(with_play) {
+      Result r = play(width, height, seed, ops);
+      printResult(r);
+      results.push_back(r);
+    }
+  }
+
+  if(json != NULL && !writeJson(json, results, seed)) {
+    std::fprintf(stderr, "%s: can't write %s\n", argv[0], json);
+    return 1;
+  }
+
+  return 0;
+}
@@ -13,281 +13,861 @@
 //---------------------------------------------------------------------------
 
 #include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "game.hpp"
+#include "placement.hpp"
+#include "replay.hpp"
+#include "wellsize.hpp"
+
+namespace {
+
+struct PieceDesc {
+  const char* desc;
+  int cindex;
+  int margins[4];
+};
 
-static const Piece PIECES[] = {
-  Piece(
+const PieceDesc PIECES[] = {
+  {
         ".x.."
         ".x.."
         ".x.."
-        ".x..", 0,			1,0,2,0),
-  Piece(
+        ".x..", 0,			{1,0,2,0}},
+  {
         "...."
         ".xx."
         ".x.."
-        ".x..", 1,			1,1,1,0),
-  Piece(
+        ".x..", 1,			{1,1,1,0}},
+  {
         "...."
         ".xx."
         "..x."
-        "..x.", 2,			1,1,1,0),
-  Piece(
+        "..x.", 2,			{1,1,1,0}},
+  {
         "...."
         ".x.."
         ".xx."
-        "..x.", 3,			1,1,1,0),
-  Piece(
+        "..x.", 3,			{1,1,1,0}},
+  {
         "...."
         "..x."
         ".xx."
-        ".x..", 4,			1,1,1,0),
-  Piece(
+        ".x..", 4,			{1,1,1,0}},
+  {
         "...."
         "xxx."
         ".x.."
-        "....", 5,			0,1,1,1),
-  Piece(
+        "....", 5,			{0,1,1,1}},
+  {
         "...."
         ".xx."
         ".xx."
-        "....", 6,			1,1,1,1)
+        "....", 6,			{1,1,1,1}}
 };
 
-Piece::Piece(const char *desc, int cindex, 
-              int left, int top, int right, int bottom)
+constexpr unsigned short descMask(const char* desc)
 {
-  std::copy(desc, desc + 16, desc_);
-  cindex_ = cindex;
-  margins_[0] = left;
-  margins_[1] = top;
-  margins_[2] = right;
-  margins_[3] = bottom;
+  unsigned short m = 0;
+  for(int i = 0; i < 16; ++i) {
+    if(desc[i] == 'x') {
+      m |= 1u << i;
+    }
+  }
+  return m;
 }
 
-Piece::Piece()
-{}
+// Row i of the rotated box is column i of the old one read bottom up.
+constexpr unsigned short rotateMaskCW(unsigned short m)
+{
+  unsigned short n = 0;
+  for(int r = 0; r < 4; ++r) {
+    for(int c = 0; c < 4; ++c) {
+      if(m & (1u << ((3-c)*4 + r))) {
+        n |= 1u << (r*4 + c);
+      }
+    }
+  }
+  return n;
+}
 
-Piece& Piece::operator =(const Piece& other)
+constexpr PieceTable buildPieceTable()
 {
-  std::copy(other.desc_, other.desc_ + 16, desc_);
-  std::copy(other.margins_, other.margins_ + 4, margins_);
-  cindex_ = other.cindex_;
-  return *this;
+  PieceTable t = {};
+  for(int p = 0; p < NUM_PIECES; ++p) {
+    unsigned short mask = descMask(PIECES[p].desc);
+    int m[4] = { PIECES[p].margins[0], PIECES[p].margins[1],
+                 PIECES[p].margins[2], PIECES[p].margins[3] };
+
+    for(int rot = 0; rot < NUM_ROTATIONS; ++rot) {
+      PieceOrientation& o = t.o[p][rot];
+      o.mask = mask;
+      o.colour = PIECES[p].cindex;
+      for(int i = 0; i < 4; ++i) {
+        o.margins[i] = m[i];
+      }
+      o.spawn_offset = 3 - m[3];
+      for(int col = 0; col < 4; ++col) {
+        o.bottom[col] = -1;
+        for(int row = 0; row < 4; ++row) {
+          if(mask & (1u << (row*4 + col))) {
+            o.bottom[col] = row;
+          }
+        }
+      }
+
+      // Two orientations cover the same cells if their masks agree once
+      // shifted up and left against the box, and their boxes are lined
+      // up accordingly.
+      o.canonical = rot;
+      o.canonical_dx = 0;
+      o.canonical_dy = 0;
+      for(int prev = rot - 1; prev >= 0; --prev) {
+        const PieceOrientation& q = t.o[p][prev];
+        if((q.mask >> (q.margins[1]*4 + q.margins[0])) ==
+           (mask >> (m[1]*4 + m[0]))) {
+          o.canonical = prev;
+          o.canonical_dx = m[0] - q.margins[0];
+          o.canonical_dy = q.margins[1] - m[1];
+        }
+      }
+
+      mask = rotateMaskCW(mask);
+      int left = m[3];
+      m[3] = m[2];
+      m[2] = m[1];
+      m[1] = m[0];
+      m[0] = left;
+    }
+  }
+  return t;
 }
 
-int Piece::getLeftMargin() const
+}
+
+constexpr PieceTable PIECE_TABLE = buildPieceTable();
+
+namespace {
+
+// Whether a row of the given number of occupancy words is full: every
+// word but the last all ones, and the last equal to last.  Wide rows
+// are ANDed together a vector at a time, as wide as the target allows.
+bool rowFull(const Game::RowMask* row, int words, Game::RowMask last)
 {
-  return margins_[0];
+  int n = words - 1;
+  int k = 0;
+
+#if defined(__AVX2__)
+  const __m256i ones256 = _mm256_set1_epi64x(-1);
+  __m256i acc256 = ones256;
+  for(; k + 4 <= n; k += 4) {
+    acc256 = _mm256_and_si256(acc256, _mm256_loadu_si256(
+                                reinterpret_cast<const __m256i*>(row + k)));
+  }
+  if(!_mm256_testc_si256(acc256, ones256)) {
+    return false;
+  }
+#endif
+
+#if defined(__SSE2__)
+  const __m128i ones128 = _mm_set1_epi32(-1);
+  __m128i acc128 = ones128;
+  for(; k + 2 <= n; k += 2) {
+    acc128 = _mm_and_si128(acc128, _mm_loadu_si128(
+                             reinterpret_cast<const __m128i*>(row + k)));
+  }
+  if(_mm_movemask_epi8(_mm_cmpeq_epi32(acc128, ones128)) != 0xffff) {
+    return false;
+  }
+#endif
+
+  for(; k < n; ++k) {
+    if(row[k] != ~Game::RowMask(0)) {
+      return false;
+    }
+  }
+  return row[n] == last;
 }
 
-int Piece::getTopMargin() const
+// Row r of piece p shifted into board columns for a piece at x, split
+// between the word it starts in, which is returned, and the next one,
+// which gets any cells that spill over the word boundary.
+int pieceRowWords(const Piece& p, int r, int x, Game::RowMask& lo,
+                  Game::RowMask& hi)
 {
-  return margins_[1];
+  Game::RowMask m = p.getRowMask(r);
+  if(x < 0) {
+    lo = m >> -x;
+    hi = 0;
+    return 0;
+  }
+
+  int shift = x & 63;
+  lo = m << shift;
+  hi = shift > 60 ? m >> (64 - shift) : 0;
+  return x >> 6;
+}
+
+}
+
+static_assert(std::is_trivially_copyable<GameState>::value,
+              "GameState must be copyable with memcpy");
+
+Game::Game(int width, int height)
+  : board_width_(width)
+  , board_height_(height)
+  , stopped_(false)
+  , seed_(rand())
+  , randomizer_(UNIFORM)
+  , piece_count_(0)
+  , line_count_(0)
+  , recorder_(NULL)
+  , logging_(false)
+  , board_hash_(0)
+  , num_full_(0)
+  , num_cleared_(0)
+  , stack_height_(0)
+{
+  allocate();
+  restartSequence();
+  generateNewPiece();
+}
+
+Game::Game(const GameState& state)
+  : board_width_(state.width)
+  , board_height_(state.height)
+  , recorder_(NULL)
+  , logging_(false)
+  , board_hash_(0)
+  , stack_height_(0)
+{
+  allocate();
+  restore(state);
+}
+
+Game::Game(const Game& other)
+  : board_width_(other.board_width_)
+  , board_height_(other.board_height_)
+  , recorder_(NULL)
+  , logging_(false)
+  , stack_height_(0)
+{
+  allocate();
+  copyFrom(other);
+}
+
+Game& Game::operator=(const Game& other)
+{
+  if(this != &other) {
+    if(board_width_ != other.board_width_ ||
+       board_height_ != other.board_height_) {
+      release();
+      board_width_ = other.board_width_;
+      board_height_ = other.board_height_;
+      allocate();
+    }
+    copyFrom(other);
+  }
+  return *this;
 }
 
-int Piece::getRightMargin() const
+void Game::allocate()
 {
-  return margins_[2];
+  assert(board_width_ > 0);
+
+  words_ = (board_width_ + 63) / 64;
+  capacity_ = std::min(board_height_+4, int(CHUNK_ROWS));
+  rows_ = new RowMask[ words_ * capacity_ ];
+  colours_ = new signed char*[ capacity_ ];
+  gap_ = 0;
+  gap_len_ = 0;
+  live_rows_ = 0;
+  full_row_ = ~RowMask(0) >> (64*words_ - board_width_);
+  hash_stale_ = false;
+  heights_ = new int[ board_width_ ];
+
+  std::fill(rows_, rows_ + words_ * capacity_, RowMask(0));
+  std::fill(heights_, heights_ + board_width_, 0);
 }
 
-int Piece::getBottomMargin() const
+void Game::release()
 {
-  return margins_[3];
+  delete [] rows_;
+  delete [] colours_;
+  delete [] heights_;
+  for(size_t i = 0; i < colour_chunks_.size(); ++i) {
+    delete [] colour_chunks_[i];
+  }
+  colour_chunks_.clear();
+  free_colours_.clear();
+  live_rows_ = 0;
 }
 
-int Piece::getColourIndex() const
+void Game::reserveRows(int n)
 {
-  return cindex_;
+  if(n <= getStoredRows()) {
+    return;
+  }
+
+  // Only wells too tall to be stored whole ever get here.  Grow
+  // geometrically, up to the height of the well, so a stack climbing a
+  // tall well only copies each row a few times.  Short of that the gap
+  // just closes, which until the stack nears the top of the well it
+  // only has to once at least as many rows have been removed since it
+  // last closed as the stack now holds.
+  assert(n <= board_height_+4);
+  int capacity = capacity_;
+  if(2 * n > capacity_) {
+    capacity = std::min(2 * n, board_height_+4);
+  }
+
+  closeGap();
+  if(capacity > capacity_) {
+    // Everything from the top of the stack up is zero, and only the
+    // live rows have colour blocks.
+    int used = words_ * stack_height_;
+    RowMask* grown = new RowMask[ words_ * capacity ];
+    std::copy(rows_, rows_ + used, grown);
+    std::fill(grown + used, grown + words_ * capacity, RowMask(0));
+    signed char** colours = new signed char*[ capacity ];
+    std::copy(colours_, colours_ + live_rows_, colours);
+
+    delete [] rows_;
+    delete [] colours_;
+    rows_ = grown;
+    colours_ = colours;
+    capacity_ = capacity;
+  }
 }
 
-Piece Piece::rotateCW() const
+void Game::moveGap(int r)
 {
-  char ndesc[16];
-  getColumnRev(0, (char*)ndesc);
-  getColumnRev(1, (char*)(ndesc+4));
-  getColumnRev(2, (char*)(ndesc+8));
-  getColumnRev(3, (char*)(ndesc+12));
+  if(gap_len_ > 0 && r > gap_) {
+    std::memmove(rows_ + words_ * gap_, rows_ + words_ * (gap_ + gap_len_),
+                 (r - gap_) * words_ * sizeof(RowMask));
+    std::memmove(colours_ + gap_, colours_ + gap_ + gap_len_,
+                 (r - gap_) * sizeof(signed char*));
+  } else if(gap_len_ > 0 && r < gap_) {
+    std::memmove(rows_ + words_ * (r + gap_len_), rows_ + words_ * r,
+                 (gap_ - r) * words_ * sizeof(RowMask));
+    std::memmove(colours_ + r + gap_len_, colours_ + r,
+                 (gap_ - r) * sizeof(signed char*));
+  }
+  gap_ = r;
+}
 
-  return Piece(ndesc, cindex_,
-		margins_[3], margins_[0], margins_[1], margins_[2]);
+void Game::closeGap()
+{
+  // The rows moved down leave copies behind above their new top, which
+  // has to be zero.
+  int top = std::max(stack_height_, live_rows_);
+  moveGap(top);
+  std::fill(rows_ + words_ * top, rows_ + words_ * (top + gap_len_),
+            RowMask(0));
+  gap_len_ = 0;
 }
 
-Piece Piece::rotateCCW() const
+void Game::setLiveRows(int n)
 {
-  char ndesc[16];
-  getColumn(3, (char*)ndesc);
-  getColumn(2, (char*)(ndesc+4));
-  getColumn(1, (char*)(ndesc+8));
-  getColumn(0, (char*)(ndesc+12));
+  while(live_rows_ > n) {
+    --live_rows_;
+    free_colours_.push_back(colours_[ slot(live_rows_) ]);
+  }
 
-  return Piece(ndesc, cindex_,
-		margins_[1], margins_[2], margins_[3], margins_[0]);
+  while(live_rows_ < n) {
+    if(free_colours_.empty()) {
+      signed char* chunk = new signed char[ CHUNK_ROWS * board_width_ ];
+      colour_chunks_.push_back(chunk);
+      for(int i = CHUNK_ROWS - 1; i >= 0; --i) {
+        free_colours_.push_back(chunk + i * board_width_);
+      }
+    }
+    signed char* row = free_colours_.back();
+    free_colours_.pop_back();
+    std::fill(row, row + board_width_, -1);
+    colours_[ slot(live_rows_++) ] = row;
+  }
 }
 
-bool Piece::isOn(int row, int col) const
+void Game::rehash() const
 {
-  return desc_[ row*4 + col ] == 'x';
+  board_hash_ = 0;
+  for(int r = 0; r < stack_height_; ++r) {
+    board_hash_ ^= zobristRow(r, getRow(r), words_);
+  }
+  hash_stale_ = false;
 }
 
-void Piece::getColumn(int col, char *buf) const
+void Game::copyFrom(const Game& other)
 {
-  buf[0] = desc_[col];
-  buf[1] = desc_[col+4];
-  buf[2] = desc_[col+8];
-  buf[3] = desc_[col+12];
+  stopped_ = other.stopped_;
+  seed_ = other.seed_;
+  rng_ = other.rng_;
+  randomizer_ = other.randomizer_;
+  std::copy(other.bag_, other.bag_ + NUM_PIECES, bag_);
+  bag_pos_ = other.bag_pos_;
+  std::copy(other.queue_, other.queue_ + PREVIEW_SIZE, queue_);
+  queue_head_ = other.queue_head_;
+
+  piece_ = other.piece_;
+  px_ = other.px_;
+  py_ = other.py_;
+  piece_count_ = other.piece_count_;
+  line_count_ = other.line_count_;
+
+  // Rows above either stack are empty in both games.  The other game's
+  // rows come across without its gap, in the runs below and above it.
+  closeGap();
+  std::fill(rows_, rows_ + words_*stack_height_, RowMask(0));
+  reserveRows(other.stack_height_);
+  int split = std::min(other.gap_, other.stack_height_);
+  const RowMask* upper = other.getRow(split);
+  std::copy(other.rows_, other.rows_ + words_*split, rows_);
+  std::copy(upper, upper + words_*(other.stack_height_ - split),
+            rows_ + words_*split);
+  setLiveRows(other.stack_height_);
+  for(int r = 0; r < other.stack_height_; ++r) {
+    const signed char* colours = other.colours_[ other.slot(r) ];
+    std::copy(colours, colours + board_width_, colours_[r]);
+  }
+  board_hash_ = other.board_hash_;
+  hash_stale_ = other.hash_stale_;
+  std::copy(other.heights_, other.heights_ + board_width_, heights_);
+
+  std::copy(other.full_, other.full_ + 4, full_);
+  num_full_ = other.num_full_;
+  std::copy(other.cleared_, other.cleared_ + 4, cleared_);
+  num_cleared_ = other.num_cleared_;
+  stack_height_ = other.stack_height_;
+
+  logReset();
 }
 
-void Piece::getColumnRev(int col, char *buf) const
+void Game::save(GameState& state) const
 {
-  buf[0] = desc_[col+12];
-  buf[1] = desc_[col+8];
-  buf[2] = desc_[col+4];
-  buf[3] = desc_[col];
+  assert(GameState::fits(board_width_, board_height_));
+
+  // Everything above the stack is empty.
+  for(int r = 0; r < stack_height_; ++r) {
+    const signed char* colours = colours_[r];
+    uint64_t word = 0;
+    for(int c = 0; c < board_width_; ++c) {
+      word |= uint64_t(colours[c] + 1) << (4*c);
+    }
+    state.rows[r] = uint16_t(rows_[r]);
+    state.colours[r] = word;
+  }
+  std::fill(state.rows + stack_height_, state.rows + GameState::MAX_ROWS, 0);
+  std::fill(state.colours + stack_height_,
+            state.colours + GameState::MAX_ROWS, 0);
+
+  state.rng = rng_;
+  state.seed = seed_;
+  state.piece_count = piece_count_;
+  state.line_count = line_count_;
+
+  state.width = board_width_;
+  state.height = board_height_;
+  state.randomizer = randomizer_;
+  state.stopped = stopped_;
+
+  state.piece = piece_.getId();
+  state.rotation = piece_.getRotation();
+  state.x = px_;
+  state.y = py_;
+
+  std::copy(bag_, bag_ + NUM_PIECES, state.bag);
+  state.bag_pos = bag_pos_;
+  std::copy(queue_, queue_ + PREVIEW_SIZE, state.queue);
+  state.queue_head = queue_head_;
+
+  state.num_cleared = num_cleared_;
+  std::copy(cleared_, cleared_ + 4, state.cleared);
 }
 
-Game::Game(int width, int height)
-  : board_width_(width)
-  , board_height_(height)
-  , stopped_(false)
+void Game::restore(const GameState& state)
 {
-  int sz = board_width_ * (board_height_+4);
+  assert(state.width == board_width_ && state.height == board_height_);
 
-  board_ = new int[ sz ];
-  std::fill(board_, board_ + sz, -1);
-  generateNewPiece();
+  // Rows above both the old stack and the new one are already empty,
+  // so only the rows below the higher of the two need writing.
+  int top = 0;
+  for(int r = 0; r < board_height_+4; ++r) {
+    if(state.rows[r] != 0) {
+      top = r + 1;
+    }
+  }
+
+  // Colour blocks above the new stack go back to the pool, which clears
+  // them before they are used again.
+  reserveRows(top);
+  setLiveRows(top);
+
+  for(int r = 0; r < top; ++r) {
+    signed char* colours = colours_[r];
+    uint64_t word = state.colours[r];
+    for(int c = 0; c < board_width_; ++c) {
+      colours[c] = int((word >> (4*c)) & 0xf) - 1;
+    }
+    board_hash_ ^= zobristRow(r, rows_[r]) ^ zobristRow(r, state.rows[r]);
+    rows_[r] = state.rows[r];
+  }
+  for(int r = top; r < stack_height_; ++r) {
+    board_hash_ ^= zobristRow(r, rows_[r]);
+  }
+  if(stack_height_ > top) {
+    std::fill(rows_ + top, rows_ + stack_height_, RowMask(0));
+  }
+  stack_height_ = top;
+
+  for(int c = 0; c < board_width_; ++c) {
+    int h = stack_height_;
+    while(h > 0 && !((rows_[h-1] >> c) & 1)) {
+      --h;
+    }
+    heights_[c] = h;
+  }
+
+  rng_ = state.rng;
+  seed_ = state.seed;
+  piece_count_ = state.piece_count;
+  line_count_ = state.line_count;
+  randomizer_ = Randomizer(state.randomizer);
+  stopped_ = state.stopped;
+
+  piece_ = Piece(state.piece, state.rotation);
+  px_ = state.x;
+  py_ = state.y;
+
+  std::copy(state.bag, state.bag + NUM_PIECES, bag_);
+  bag_pos_ = state.bag_pos;
+  std::copy(state.queue, state.queue + PREVIEW_SIZE, queue_);
+  queue_head_ = state.queue_head;
+
+  num_full_ = 0;
+  num_cleared_ = state.num_cleared;
+  std::copy(state.cleared, state.cleared + 4, cleared_);
+
+  logReset();
 }
 
 void Game::reset()
 {
   stopped_ = false;
-  std::fill(board_, board_ + (board_width_*(board_height_+4)), -1);
+  num_full_ = 0;
+  num_cleared_ = 0;
+  piece_count_ = 0;
+  line_count_ = 0;
+  board_hash_ = 0;
+  hash_stale_ = false;
+  // Rows above the stack are already empty.
+  closeGap();
+  std::fill(rows_, rows_ + words_*stack_height_, RowMask(0));
+  setLiveRows(0);
+  std::fill(heights_, heights_ + board_width_, 0);
+  stack_height_ = 0;
   generateNewPiece();
+  logReset();
+}
+
+void Game::seed(uint64_t s)
+{
+  seed_ = s;
+  restartSequence();
+}
+
+void Game::setRandomizer(Randomizer randomizer)
+{
+  randomizer_ = randomizer;
+  restartSequence();
 }
 
 Game::~Game()
 {
-  delete [] board_;
+  release();
 }
 
 int Game::get(int r, int c) const
 {
-  return board_[ r*board_width_ + c ];
+  // The falling piece lives on top of the locked cells rather than in
+  // them, so compose the two here.
+  int pr = py_ - r;
+  int pc = c - px_;
+
+  if(pr >= 0 && pr < 4 && pc >= 0 && pc < 4 && piece_.isOn(pr, pc)) {
+    return piece_.getColourIndex();
+  }
+
+  return getLocked(r, c);
 }
 
-int& Game::get(int r, int c) 
+int Game::dropDistance(const Piece& p, int x, int y) const
 {
-  return board_[ r*board_width_ + c ];
+  // If the lowest cell of the piece in every column is at or above
+  // the surface of that column, then everything between the piece and
+  // the surface is empty and the piece falls until one of its columns
+  // meets the surface.  Otherwise the piece has been slid under an
+  // overhang, and we have to step it down the slow way.
+
+  int dist = y - (3 - p.getBottomMargin());
+
+  for(int c = p.getLeftMargin(); c < 4 - p.getRightMargin(); ++c) {
+    int b = y - p.getColumnBottom(c);
+    int h = heights_[ x+c ];
+
+    if(b < h) {
+      int ny = y;
+      while(doesPieceFit(p, x, ny - 1)) {
+        --ny;
+      }
+      return y - ny;
+    }
+
+    dist = std::min(dist, b - h);
+  }
+
+  return dist;
 }
 
-bool Game::doesPieceFit(const Piece& p, int x, int y) const
+int Game::collapse()
 {
-  if(x + p.getLeftMargin() < 0) {
-    return false;
+  int removed = 0;
+  withWellSize(board_width_, board_height_, [&](auto size) {
+    removed = collapse(size);
+  });
+  return removed;
+}
+
+void Game::placePiece(const Piece& p, int x, int y)
+{
+  withWellSize(board_width_, board_height_, [&](auto size) {
+    placePiece(size, p, x, y);
+  });
+}
+
+template<class Size>
+int Game::collapse(Size size)
+{
+  const int width = size.width();
+  const int words = size.words();
+
+  // placePiece() has already noted which rows it filled.  In a well
+  // stored whole, each run of surviving rows between them moves as a
+  // block, over the full rows: a memmove of occupancy words, and of
+  // pointers to colour blocks.  The runs above the first full row move
+  // down over them, and rows below the first full row and above the
+  // stack never move.  A taller well moves the gap to each full row in
+  // turn and widens it over the row instead.
+
+  num_cleared_ = num_full_;
+  num_full_ = 0;
+
+  if(num_cleared_ == 0) {
+    return 0;
   }
 
-  if(x + 3 - p.getRightMargin() >= board_width_) {
-    return false;
+  std::copy(full_, full_ + num_cleared_, cleared_);
+
+  int top = stack_height_;
+  int first = cleared_[0];
+
+  // Every row above the first full row changes key, so on a tall stack
+  // it is cheaper to rehash the board if and when the hash is wanted.
+  if(top - first > REHASH_ROWS) {
+    hash_stale_ = true;
   }
 
-  if(y + p.getBottomMargin() < 3) {
-    return false;
+  for(int i = 0; i < num_cleared_; ++i) {
+    int full = cleared_[i];
+    free_colours_.push_back(colours_[ slot(full) ]);
+    if(!hash_stale_) {
+      board_hash_ ^= zobristRow(full, getRow(full), words);
+    }
   }
 
-  for(int r = 0; r < 4; ++r) {
-    for(int c = 0; c < 4; ++c) {
-      if(p.isOn(r, c)) {
-        if(get(y-r, x+c) != -1) {
-          return false;
+  if(board_height_+4 > CHUNK_ROWS) {
+    if(!hash_stale_) {
+      int i = 1;
+      for(int r = first + 1; r < top; ++r) {
+        if(i < num_cleared_ && r == cleared_[i]) {
+          ++i;
+          continue;
         }
+        const RowMask* row = getRow(r);
+        board_hash_ ^= zobristRow(r, row, words) ^
+                       zobristRow(r - i, row, words);
       }
     }
-  }
 
-  return true;
-}
+    // Each full row has the ones before it removed from beneath it.
+    for(int i = 0; i < num_cleared_; ++i) {
+      moveGap(cleared_[i] - i);
+      ++gap_len_;
+    }
+    live_rows_ -= num_cleared_;
+  } else {
+    int dst = first;
+    for(int i = 0; i < num_cleared_; ++i) {
+      int src = cleared_[i] + 1;
+      int end = i + 1 < num_cleared_ ? cleared_[i+1] : top;
+      if(end == src) {
+        continue;
+      }
 
-void Game::removePiece(const Piece& p, int x, int y) 
-{
-  for(int r = 0; r < 4; ++r) {
-    for(int c = 0; c < 4; ++c) {
-      if(p.isOn(r, c)) {
-        get(y-r, x+c) = -1;
+      if(!hash_stale_) {
+        for(int r = src; r < end; ++r) {
+          const RowMask* row = rows_ + r*words;
+          board_hash_ ^= zobristRow(r, row, words) ^
+                         zobristRow(dst + (r - src), row, words);
+        }
       }
+      std::memmove(rows_ + dst*words, rows_ + src*words,
+                   (end - src) * words * sizeof(RowMask));
+      std::copy(colours_ + src, colours_ + end, colours_ + dst);
+      dst += end - src;
     }
+
+    // What is left between the moved rows and the old top of the stack
+    // are copies of moved pointers and pointers to blocks now in the
+    // pool.  The live blocks above the stack come down over them.
+    std::fill(rows_ + dst*words, rows_ + top*words, RowMask(0));
+    std::copy(colours_ + top, colours_ + live_rows_, colours_ + dst);
+    live_rows_ -= top - dst;
   }
-}
 
-void Game::removeRow(int y)
-{
-  for(int r = y + 1; r < board_height_ + 4; ++r) {
-    for(int c = 0; c < board_width_; ++c) {
-      get(r-1, c) = get(r, c);
+  // Every column loses the cleared rows beneath its top cell.  If its
+  // top cell was itself cleared, walk down to the next filled one.
+  stack_height_ = 0;
+  for(int c = 0; c < width; ++c) {
+    int h = heights_[c];
+    for(int i = 0; i < num_cleared_ && cleared_[i] < heights_[c]; ++i) {
+      --h;
     }
+    while(h > 0 && !((getRow(h-1)[c >> 6] >> (c & 63)) & 1)) {
+      --h;
+    }
+    heights_[c] = h;
+    stack_height_ = std::max(stack_height_, h);
   }
 
-  for(int c = 0; c < board_width_; ++c) {
-    get(board_height_+3, c) = -1;
-  }
+  return num_cleared_;
 }
 
-int Game::collapse() 
+template<class Size>
+void Game::placePiece(Size size, const Piece& p, int x, int y)
 {
-  // This method is implemented in a brain-dead way.  Repeatedly
-  // walk up from the bottom of the well, removing the first full 
-  // row, stopping when there are no more full rows.  It could be
-  // made much faster.  Sue me.
+  const int words = size.words();
 
-  int removed = 0;
+  // The piece may reach above the rows stored so far.
+  int top = y - p.getTopMargin() + 1;
+  if(top > live_rows_) {
+    reserveRows(top);
+    setLiveRows(top);
+  }
 
-  while(true) {
-    bool got_one = false;
-    for(int r = 0; r < board_height_ + 4; ++r) {
-      int holes = 0;
+  // Walk the piece from its bottom row up, so that any rows it fills
+  // are noted in increasing order.
+  num_full_ = 0;
 
-      for(int c = 0; c < board_width_; ++c) {
-        if(get(r, c) == -1) {
-          holes = 1;
-          break;
-        }
-      }
+  for(int r = 3 - p.getBottomMargin(); r >= p.getTopMargin(); --r) {
+    int row = y - r;
+    RowMask* cells = rows_ + slot(row)*words;
 
-      if(holes == 0) {
-        got_one = 1;
-        ++removed;
-        removeRow(r);
-        break;
-      }
+    // A row's key is the XOR of its words' keys, so only the words
+    // the piece touches need rehashing.
+    RowMask lo;
+    RowMask hi = 0;
+    int w = 0;
+    if(words == 1) {
+      lo = pieceRowMask(p, r, x);
+    } else {
+      w = pieceRowWords(p, r, x, lo, hi);
+    }
+
+    uint64_t key = zobristWord(row, w);
+    board_hash_ ^= zobristRow(key, cells[w]);
+    cells[w] |= lo;
+    board_hash_ ^= zobristRow(key, cells[w]);
+    if(hi != 0) {
+      key = zobristWord(row, w + 1);
+      board_hash_ ^= zobristRow(key, cells[w+1]);
+      cells[w+1] |= hi;
+      board_hash_ ^= zobristRow(key, cells[w+1]);
     }
 
-    if(!got_one) {
-      break;
+    // Visit just the filled cells of this row of the piece.
+    for(unsigned m = p.getRowMask(r); m != 0; m &= m - 1) {
+      int c = x + __builtin_ctz(m);
+      colours_[ slot(row) ][c] = p.getColourIndex();
+      heights_[c] = std::max(heights_[c], row + 1);
+    }
+
+    if(words == 1 ? cells[0] == full_row_
+                  : rowFull(cells, words, full_row_)) {
+      full_[num_full_++] = row;
     }
   }
 
-  return removed;
+  stack_height_ = std::max(stack_height_, top);
 }
 
-void Game::placePiece(const Piece& p, int x, int y)
+bool Game::wideRowHits(const Piece& p, int r, int x, int row) const
 {
-  for(int r = 0; r < 4; ++r) {
-    for(int c = 0; c < 4; ++c) {
-      if(p.isOn(r, c)) {
-        get(y-r, x+c) = p.getColourIndex();
-      }
+  const RowMask* cells = getRow(row);
+  RowMask lo;
+  RowMask hi;
+  int w = pieceRowWords(p, r, x, lo, hi);
+  return (cells[w] & lo) || (hi != 0 && (cells[w+1] & hi));
+}
+	
+void Game::restartSequence()
+{
+  rng_.seed(seed_);
+  bag_pos_ = NUM_PIECES;
+  queue_head_ = 0;
+  for(int i = 0; i < PREVIEW_SIZE; ++i) {
+    queue_[i] = drawPiece();
+  }
+}
+
+int Game::drawPiece()
+{
+  if(randomizer_ == UNIFORM) {
+    return rng_.below(NUM_PIECES);
+  }
+
+  if(bag_pos_ == NUM_PIECES) {
+    // Deal out a freshly shuffled bag.
+    for(int i = 0; i < NUM_PIECES; ++i) {
+      bag_[i] = i;
     }
+    for(int i = NUM_PIECES - 1; i > 0; --i) {
+      std::swap(bag_[i], bag_[ rng_.below(i + 1) ]);
+    }
+    bag_pos_ = 0;
   }
+
+  return bag_[ bag_pos_++ ];
 }
-	
+
 void Game::generateNewPiece() 
 {
-  piece_ = PIECES[ rand() % 7 ];
+  piece_ = Piece(queue_[ queue_head_ ], 0);
+  ++piece_count_;
+  queue_[ queue_head_ ] = drawPiece();
+  queue_head_ = (queue_head_ + 1) % PREVIEW_SIZE;
 
-  int xleft = (board_width_-3) / 2;
-
-  px_ = xleft;
-  py_ = board_height_ + 3 - piece_.getBottomMargin();
-  placePiece(piece_, px_, py_);
+  px_ = spawnX(board_width_);
+  py_ = spawnY(board_height_, piece_);
 }
 
 int Game::tick()
@@ -296,23 +876,32 @@ int Game::tick()
     return -1;
   }
 
-  removePiece(piece_, px_, py_);
+  if(recorder_) {
+    recorder_->tick(*this);
+  }
+
   int ny = py_ - 1;
 
   if(!doesPieceFit(piece_, px_, ny)) {
     // Must finish off with this piece
     placePiece(piece_, px_, py_);
+    logChange(Change::PIECE_LOCKED, piece_, px_, py_);
     if(py_ >= board_height_) {
       // you lose.
       stopped_ = true;
       return -1;
     } else {
       int rm = collapse();
+      line_count_ += rm;
+      for(int i = rm - 1; i >= 0; --i) {
+        logChange(Change::ROW_REMOVED, piece_, 0, cleared_[i]);
+      }
       generateNewPiece();
+      logChange(Change::PIECE_SPAWNED, piece_, px_, py_);
       return rm;
     }
   } else {
-    placePiece(piece_, px_, ny);
+    logChange(Change::PIECE_MOVED, piece_, px_, ny);
     py_ = ny;
     return 0;
   }
@@ -320,22 +909,19 @@ int Game::tick()
 
 bool Game::moveLeft()
 {
-  // Most of the piece movement methods work like this:
-  //  1. remove the piece from the board.
-  // 	2. does the piece fit in its new configuration?
-  //	3a. if yes, add it to the board in its new configuration.
-  //	3b. if no, put it back where it was.
-  // Simple and sort of silly, but satisfactory.
+  // The falling piece is never written into the board, so all of the
+  // piece movement methods just check whether the piece fits in its
+  // new configuration and, if it does, move it there.  The board only
+  // changes when a piece locks in tick().
 
   int nx = px_ - 1;
 
-  removePiece(piece_, px_, py_);
   if(doesPieceFit(piece_, nx, py_)) {
-    placePiece(piece_, nx, py_);
+    logChange(Change::PIECE_MOVED, piece_, nx, py_);
     px_ = nx;
+    record(MOVE_LEFT);
     return true;
   } else {
-    placePiece(piece_, px_, py_);
     return false;
   }
 }
@@ -344,64 +930,147 @@ bool Game::moveRight()
 {
   int nx = px_ + 1;
 
-  removePiece(piece_, px_, py_);
   if(doesPieceFit(piece_, nx, py_)) {
-    placePiece(piece_, nx, py_);
+    logChange(Change::PIECE_MOVED, piece_, nx, py_);
     px_ = nx;
+    record(MOVE_RIGHT);
     return true;
   } else {
-    placePiece(piece_, px_, py_);
     return false;
   }
 }
 
 bool Game::drop()
 {
-  removePiece(piece_, px_, py_);
-  int ny = py_;
-
-  while(true) {
-    --ny;
-    if(!doesPieceFit(piece_, px_, ny)) {
-      break;
-    }
-  }
-
-  ++ny;
-  placePiece(piece_, px_, ny);
+  int ny = py_ - dropDistance(piece_, px_, py_);
 	
   if(ny == py_) {
     return false;
   } else {
+    logChange(Change::PIECE_MOVED, piece_, px_, ny);
     py_ = ny;
+    record(MOVE_DROP);
     return true;
   }
 }
 
 bool Game::rotateCW() 
 {
-  removePiece(piece_, px_, py_);
   Piece npiece = piece_.rotateCW();
   if(doesPieceFit(npiece, px_, py_)) {
-    placePiece(npiece, px_, py_);
+    logChange(Change::PIECE_MOVED, npiece, px_, py_);
     piece_ = npiece;
+    record(MOVE_ROTATE_CW);
     return true;
   } else {
-    placePiece(piece_, px_, py_);
     return false;
   }
 }
 
 bool Game::rotateCCW() 
 {
-  removePiece(piece_, px_, py_);
   Piece npiece = piece_.rotateCCW();
   if(doesPieceFit(npiece, px_, py_)) {
-    placePiece(npiece, px_, py_);
+    logChange(Change::PIECE_MOVED, npiece, px_, py_);
     piece_ = npiece;
+    record(MOVE_ROTATE_CCW);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+bool Game::moveDown()
+{
+  int ny = py_ - 1;
+
+  if(doesPieceFit(piece_, px_, ny)) {
+    logChange(Change::PIECE_MOVED, piece_, px_, ny);
+    py_ = ny;
+    record(MOVE_DOWN);
     return true;
   } else {
-    placePiece(piece_, px_, py_);
     return false;
   }
 }
+
+void Game::record(Move move)
+{
+  if(recorder_) {
+    recorder_->input(move);
+  }
+}
+
+void Game::setChangeLog(bool on)
+{
+  logging_ = on;
+  changes_.clear();
+  logReset();
+}
+
+bool Game::drainChanges(std::vector<Change>& out)
+{
+  // Swapping hands the caller's buffer back to be logged into, so
+  // neither side allocates once both have grown.
+  out.clear();
+  out.swap(changes_);
+  return !out.empty();
+}
+
+void Game::pushChange(Change::Type type, const Piece& p, int x, int y)
+{
+  if(!changes_.empty() && changes_[0].type == Change::RESET) {
+    return;
+  }
+  if(int(changes_.size()) >= MAX_CHANGES) {
+    logReset();
+    return;
+  }
+
+  Change change;
+  change.type = type;
+  change.piece = p.getId();
+  change.rotation = p.getRotation();
+  change.from_rotation = piece_.getRotation();
+  change.x = x;
+  change.y = y;
+  change.from_x = px_;
+  change.from_y = py_;
+  changes_.push_back(change);
+}
+
+void Game::logReset()
+{
+  if(!logging_) {
+    return;
+  }
+
+  changes_.clear();
+  Change change = { Change::RESET, 0, 0, 0, 0, 0, 0, 0 };
+  changes_.push_back(change);
+}
+
+bool Game::apply(Move move)
+{
+  switch(move) {
+  case MOVE_LEFT:
+    return moveLeft();
+  case MOVE_RIGHT:
+    return moveRight();
+  case MOVE_ROTATE_CW:
+    return rotateCW();
+  case MOVE_ROTATE_CCW:
+    return rotateCCW();
+  case MOVE_DOWN:
+    return moveDown();
+  case MOVE_DROP:
+    return drop();
+  }
+  return false;
+}
+
+void Game::getPlacements(std::vector<Placement>& out) const
+{
+  PlacementFinder finder;
+  finder.find(getRows(), board_width_, board_height_, piece_, px_, py_, out);
+}
@@ -15,48 +15,272 @@
 #ifndef CS488_GAME_HPP
 #define CS488_GAME_HPP
 
+#include <cassert>
+#include <stdint.h>
+#include <vector>
+
+#include "random.hpp"
+#include "zobrist.hpp"
+
+// The number of different pieces, and the number of orientations
+// each one can be rotated through.
+const int NUM_PIECES = 7;
+const int NUM_ROTATIONS = 4;
+
+// One orientation of one piece.  Bit (r*4 + c) of mask is set when
+// cell (r,c) of the 4x4 box is filled; margins are left, top, right,
+// bottom.
+struct PieceOrientation {
+  unsigned short mask;
+  signed char colour;
+  signed char margins[4];
+  signed char spawn_offset;
+  // For each column of the box, the lowest filled row, or -1 if the
+  // column is empty.
+  signed char bottom[4];
+  // The lowest-numbered orientation of the same piece that covers
+  // exactly the same cells, and how far its anchor is from this one's.
+  // Symmetric pieces have fewer than four distinct orientations.
+  signed char canonical;
+  signed char canonical_dx;
+  signed char canonical_dy;
+};
+
+struct PieceTable {
+  PieceOrientation o[NUM_PIECES][NUM_ROTATIONS];
+};
+
+// Built at compile time in game.cpp.
+extern const PieceTable PIECE_TABLE;
+
+// A piece is just an index into the table of precomputed orientations,
+// so copying or rotating one costs nothing.
 class Piece {
 public:
-  Piece();
-  Piece(const char *desc, int cindex, 
-         int left, int top, int right, int bottom);
+  Piece()
+    : id_(0)
+    , rot_(0)
+  {}
+  // Piece number id in the given orientation.  Orientation 0 is the
+  // one a piece spawns in; each step after that is a quarter turn
+  // clockwise.
+  Piece(int id, int rotation)
+    : id_(id)
+    , rot_(rotation)
+  {}
+
+  int getLeftMargin() const
+  {
+    return orientation().margins[0];
+  }
+  int getTopMargin() const
+  {
+    return orientation().margins[1];
+  }
+  int getRightMargin() const
+  {
+    return orientation().margins[2];
+  }
+  int getBottomMargin() const
+  {
+    return orientation().margins[3];
+  }
+  int getColourIndex() const
+  {
+    return orientation().colour;
+  }
+  int getId() const
+  {
+    return id_;
+  }
+  int getRotation() const
+  {
+    return rot_;
+  }
+
+  // How far above the top of the well the piece's anchor row sits
+  // when the piece spawns in this orientation.
+  int getSpawnOffset() const
+  {
+    return orientation().spawn_offset;
+  }
+
+  Piece rotateCW() const
+  {
+    return Piece(id_, (rot_ + 1) % NUM_ROTATIONS);
+  }
+  Piece rotateCCW() const
+  {
+    return Piece(id_, (rot_ + NUM_ROTATIONS - 1) % NUM_ROTATIONS);
+  }
 
-  Piece& operator =(const Piece& other);
+  bool isOn(int row, int col) const
+  {
+    return (orientation().mask >> (row*4 + col)) & 1;
+  }
 
-  int getLeftMargin() const;
-  int getTopMargin() const;
-  int getRightMargin() const;
-  int getBottomMargin() const;
-  int getColourIndex() const;
+  // The lowest filled row of the given column of the piece's 4x4 box,
+  // or -1 if that column is empty.
+  int getColumnBottom(int col) const
+  {
+    return orientation().bottom[col];
+  }
 
-  Piece rotateCW() const;
-  Piece rotateCCW() const;
+  // The cells of the given row of the piece's 4x4 box, as a bit mask
+  // with bit c set for column c.
+  unsigned getRowMask(int row) const
+  {
+    return (orientation().mask >> (row*4)) & 0xf;
+  }
 
-  bool isOn(int row, int col) const;
+  const PieceOrientation& orientation() const
+  {
+    return PIECE_TABLE.o[ id_ ][ rot_ ];
+  }
 
 private:
-  void getColumn(int col, char *buf) const;
-  void getColumnRev(int col, char *buf) const;
+  unsigned char id_;
+  unsigned char rot_;
+};
 
-  char desc_[16];
-  int cindex_;
-  int margins_[4];
+// A single input that moves the falling piece.  MOVE_DOWN lowers the
+// piece one row, as a tick would, but never locks it in.
+enum Move {
+  MOVE_LEFT,
+  MOVE_RIGHT,
+  MOVE_ROTATE_CW,
+  MOVE_ROTATE_CCW,
+  MOVE_DOWN,
+  MOVE_DROP
 };
 
+// A place where the falling piece can come to rest: the anchor
+// position and orientation it lands in, and the moves that take it
+// there.  Once the moves have been applied, the next tick locks the
+// piece in.
+struct Placement {
+  int x;
+  int y;
+  int rotation;
+  std::vector<Move> path;
+};
+
+struct GameState;
+class ReplayWriter;
+
 class Game
 {
 public:
+  // How new pieces are chosen: each one independently at random, or by
+  // dealing out shuffled bags holding one of each piece.
+  enum Randomizer {
+    UNIFORM,
+    BAG
+  };
+
+  // One change to what get() shows, as logged for consumers that only
+  // want to process what changed; see setChangeLog().  Positions are
+  // piece anchors, as for getPieceX() and getPieceY().
+  struct Change
+  {
+    enum Type {
+      // Anything at all may have changed: read the whole board and the
+      // falling piece again, as they are when the log is drained.  A
+      // RESET is always the only change in the log, since it covers
+      // everything that happens after it too.
+      RESET,
+      // The falling piece moved from (from_x, from_y) in orientation
+      // from_rotation to (x, y) in orientation rotation.
+      PIECE_MOVED,
+      // The falling piece, at (x, y), became locked cells.
+      PIECE_LOCKED,
+      // Row y was removed, and every row above it moved down one.
+      // Rows removed together come in decreasing order, so each y is
+      // a row of the board as the changes before it left it.
+      ROW_REMOVED,
+      // A new piece appeared at (x, y).
+      PIECE_SPAWNED
+    };
+
+    uint8_t type;
+    uint8_t piece;
+    uint8_t rotation;
+    uint8_t from_rotation;
+    int32_t x;
+    int32_t y;
+    int32_t from_x;
+    int32_t from_y;
+  };
+
+  // A log that isn't drained within this many changes is replaced with
+  // a single RESET.
+  static const int MAX_CHANGES = 1024;
+
+  // How many upcoming pieces can be looked at with peekNext().
+  static const int PREVIEW_SIZE = 8;
+
+  // Rows are only stored as the stack grows into them, at least this
+  // many at a time, so a very tall well costs memory in proportion to
+  // the rows in use.  A well up to CHUNK_ROWS - 4 rows high is stored
+  // whole from the start.
+  static const int CHUNK_ROWS = 64;
+
   // Create a new game instance with a well of the given dimensions.
   // Note that internally, the board has four extra rows, to hold a 
-  // piece that has just begun to fall.
+  // piece that has just begun to fall.  Each row is stored as one or
+  // more 64-bit occupancy words, so the well can be as wide as you
+  // like, but the placement search and the AI only handle wells that
+  // fit in a single word, and that are stored whole.
   Game(int width, int height);
 
+  // Create a game from a snapshot, with the snapshot's dimensions.
+  explicit Game(const GameState& state);
+
+  // Games copy deeply; each one owns its own board.  A copy is never
+  // recorded, and assigning to a game leaves its recorder alone.
+  Game(const Game& other);
+  Game& operator=(const Game& other);
+
   ~Game();
 
+  // Copy the whole state of the game into a snapshot, or put it back
+  // the way it was.  A snapshot can only be restored into a game with
+  // the same dimensions, and only wells that GameState::fits() can be
+  // saved at all.
+  void save(GameState& state) const;
+  void restore(const GameState& state);
+
   // Set the game to an initial state -- empty well, one piece waiting
   // on top.
   void reset();
 
+  // Restart the sequence of pieces from the given seed.  Each game
+  // draws its pieces from its own generator, so games can run on
+  // different threads without sharing any state, and a game can be
+  // replayed exactly from its seed.  Until this is called, the seed is
+  // taken from rand().  The new sequence starts with the piece that
+  // the next reset() brings in.
+  void seed(uint64_t s);
+  uint64_t getSeed() const
+  {
+    return seed_;
+  }
+
+  // Choose how pieces are generated.  This also restarts the sequence
+  // of pieces from the current seed.
+  void setRandomizer(Randomizer randomizer);
+  Randomizer getRandomizer() const
+  {
+    return randomizer_;
+  }
+
+  // The ID of the piece that will fall i pieces after the current one,
+  // for i in [0, PREVIEW_SIZE).
+  int peekNext(int i) const
+  {
+    return queue_[ (queue_head_ + i) % PREVIEW_SIZE ];
+  }
+
   // Advance the game by one tick.  This usually just pushes the 
   // currently falling piece down by one row.  It can sometimes cause
   // one or more rows to be filled and removed.  This method returns
@@ -81,6 +305,56 @@ public:
   bool rotateCW();
   bool rotateCCW();
 
+  // Move the piece down one row if it fits there, without ever locking
+  // it in.  Returns whether the move was successful.
+  bool moveDown();
+
+  // Apply one of the moves above.  Returns whether it was successful.
+  bool apply(Move move);
+
+  // Record every tick and every successful move from now on with the
+  // given writer, or stop recording if it is NULL.
+  void setRecorder(ReplayWriter* recorder)
+  {
+    recorder_ = recorder;
+  }
+
+  // Log every change to the board and the falling piece from now on,
+  // or stop logging and drop anything logged.  The log starts with a
+  // RESET.  A copy of a game never logs; assigning to one, restoring
+  // it or resetting it logs a RESET in place of whatever came before.
+  void setChangeLog(bool on);
+  bool isLoggingChanges() const
+  {
+    return logging_;
+  }
+
+  // Swap the changes logged since the last call into out, replacing
+  // what was there, and start the log over.  Returns whether there
+  // were any.
+  bool drainChanges(std::vector<Change>& out);
+
+  // Find every distinct place the falling piece can reach and come to
+  // rest, with the moves that take it there from where it is now.  See
+  // PlacementFinder, which can be reused to avoid allocating, and which
+  // only handles wells up to 64 wide.
+  void getPlacements(std::vector<Placement>& out) const;
+
+  // The falling piece, and the position of its anchor: the top left
+  // corner of its 4x4 box, with y counting rows up from the bottom.
+  const Piece& getPiece() const
+  {
+    return piece_;
+  }
+  int getPieceX() const
+  {
+    return px_;
+  }
+  int getPieceY() const
+  {
+    return py_;
+  }
+
   int getWidth() const
   { 
     return board_width_;
@@ -100,30 +374,345 @@ public:
   // rows are added on to accommodate new pieces that are falling into
   // the well.
   int get(int r, int c) const;
-  int& get(int r, int c);
+
+  // The same, but for the locked cells alone, leaving out the falling
+  // piece.
+  int getLocked(int r, int c) const
+  {
+    return r < live_rows_ ? colours_[ slot(r) ][c] : -1;
+  }
+
+  // How many pieces have started to fall since the last reset().
+  long getPieceCount() const
+  {
+    return piece_count_;
+  }
+
+  // How many rows have been removed since the last reset().
+  long getLineCount() const
+  {
+    return line_count_;
+  }
+
+  // The rows removed when the most recent piece locked, as indices
+  // into the board as it was before they were removed, in increasing
+  // order.  Useful for animating a clear.
+  int getClearedRowCount() const
+  {
+    return num_cleared_;
+  }
+  int getClearedRow(int i) const
+  {
+    return cleared_[ i ];
+  }
+
+  // A 64-bit Zobrist hash of the locked cells, kept up to date as
+  // pieces lock and rows are removed; and of the locked cells together
+  // with the falling piece, its orientation and its position.  Colours
+  // play no part, so two games hash the same whenever the same cells
+  // are filled.  A clear that moves more than REHASH_ROWS rows leaves
+  // the hash to be worked out afresh the next time it is asked for, so
+  // a game with a very tall stack shouldn't have its hash asked for
+  // from several threads at once.
+  uint64_t getBoardHash() const
+  {
+    if(hash_stale_) {
+      rehash();
+    }
+    return board_hash_;
+  }
+  uint64_t getHash() const
+  {
+    return board_hash_ ^
+           zobristPiece(piece_.getId(), piece_.getRotation(), px_, py_);
+  }
+
+  // One bit per cell, bit c of a row for column c.
+  typedef uint64_t RowMask;
+
+  // The locked cells (not including the falling piece) as occupancy
+  // words, getRowWords() of them for each of the first
+  // getStoredRows() rows; every row above those is empty.  Column c of
+  // a row is bit c%64 of its word c/64.  getRow() gives the words of
+  // any one of those rows; getRows() gives them all, one row after
+  // another, but only while the whole well is stored, which is always
+  // the case for a well up to CHUNK_ROWS - 4 rows high.
+  const RowMask* getRow(int r) const
+  {
+    return rows_ + words_ * slot(r);
+  }
+  const RowMask* getRows() const
+  {
+    assert(getStoredRows() == board_height_+4);
+    return rows_;
+  }
+  int getRowWords() const
+  {
+    return words_;
+  }
+  int getStoredRows() const
+  {
+    return capacity_ - gap_len_;
+  }
+
+  // Row r of piece p, shifted into board columns for a piece at x.
+  static RowMask pieceRowMask(const Piece& p, int r, int x)
+  {
+    RowMask m = p.getRowMask(r);
+    return x >= 0 ? m << x : m >> -x;
+  }
+
+  // Where a new piece p appears in a well of the given dimensions.
+  static int spawnX(int width)
+  {
+    return (width-3) / 2;
+  }
+  static int spawnY(int height, const Piece& p)
+  {
+    return height + p.getSpawnOffset();
+  }
+
+  // Whether piece p, anchored at (x,y), fits on a board of the given
+  // width, at most 64, whose locked cells are given by rows.
+  static bool pieceFits(const RowMask* rows, int width,
+                        const Piece& p, int x, int y)
+  {
+    if(x + p.getLeftMargin() < 0) {
+      return false;
+    }
+
+    if(x + 3 - p.getRightMargin() >= width) {
+      return false;
+    }
+
+    if(y + p.getBottomMargin() < 3) {
+      return false;
+    }
+
+    // Only the rows between the margins hold any cells, and only those
+    // are guaranteed to lie inside the board.
+    for(int r = p.getTopMargin(); r < 4 - p.getBottomMargin(); ++r) {
+      if(rows[y-r] & pieceRowMask(p, r, x)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
 
 private:
-  bool doesPieceFit(const Piece& p, int x, int y) const;
+  void allocate();
+  void release();
+  void copyFrom(const Game& other);
+
+  // Pass a successful move on to the recorder, if there is one.
+  void record(Move move);
+
+  // Log a change of the given type, if changes are being logged, for
+  // the falling piece about to become p at (x,y).
+  void logChange(Change::Type type, const Piece& p, int x, int y)
+  {
+    if(logging_) {
+      pushChange(type, p, x, y);
+    }
+  }
+  void pushChange(Change::Type type, const Piece& p, int x, int y);
+  // Replace anything logged with a RESET.
+  void logReset();
+
+  bool doesPieceFit(const Piece& p, int x, int y) const
+  {
+    if(x + p.getLeftMargin() < 0 ||
+       x + 3 - p.getRightMargin() >= board_width_ ||
+       y + p.getBottomMargin() < 3) {
+      return false;
+    }
+
+    // Everything at and above the top of the stack is empty, and
+    // needn't be stored, so only the piece's rows below it are tested.
+    int first = y - stack_height_ + 1;
+    if(first < p.getTopMargin()) {
+      first = p.getTopMargin();
+    }
+    for(int r = first; r < 4 - p.getBottomMargin(); ++r) {
+      if(words_ == 1 ? (rows_[ slot(y-r) ] & pieceRowMask(p, r, x)) != 0
+                     : wideRowHits(p, r, x, y-r)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+  // Whether row r of piece p at x meets any locked cell of the given
+  // row, in a well more than one word wide.
+  bool wideRowHits(const Piece& p, int r, int x, int row) const;
+
+  // Where row r is kept in the stores: rows at and above the gap are
+  // kept gap_len_ rows further up.
+  int slot(int r) const
+  {
+    return r < gap_ ? r : r + gap_len_;
+  }
+  // Make sure the first n rows are stored.
+  void reserveRows(int n);
+  // Move the gap to just below row r, moving the rows in between
+  // across it.
+  void moveGap(int r);
+  // Move every row above the gap down over it.
+  void closeGap();
+  // Give exactly the first n rows colour blocks, taking blocks from
+  // the pool or handing them back to it.
+  void setLiveRows(int n);
+  // Work the board hash out from scratch.
+  void rehash() const;
+
+  // How far the piece at (x,y) can fall before it lands.
+  int dropDistance(const Piece& p, int x, int y) const;
 
-  void removeRow(int y);
+  // Remove the rows filled by the last piece placed.
   int collapse();
 
-  void removePiece(const Piece& p, int x, int y);
+  // Write a piece into the locked cells of the board.
   void placePiece(const Piece& p, int x, int y);
 
+  // The same, compiled for the well size given by Size; see
+  // wellsize.hpp.  The two above pick which one to call.
+  template<class Size> int collapse(Size size);
+  template<class Size> void placePiece(Size size, const Piece& p,
+                                       int x, int y);
+
   void generateNewPiece();
 
+  // Start the piece sequence over from seed_, refilling the preview
+  // queue; and draw one more piece onto the end of it.
+  void restartSequence();
+  int drawPiece();
+
 private:
   int board_width_;
   int board_height_;
 
   bool stopped_;
 
+  // The piece generator, the current bag (for the BAG randomizer) and
+  // the queue of upcoming pieces.
+  uint64_t seed_;
+  Random rng_;
+  Randomizer randomizer_;
+  int bag_[ NUM_PIECES ];
+  int bag_pos_;
+  int queue_[ PREVIEW_SIZE ];
+  int queue_head_;
+
+  // The falling piece.  It is drawn over the board by get() but is
+  // only written into the locked cells when it locks.
   Piece piece_;
   int px_;
   int py_;
+  long piece_count_;
+  long line_count_;
+
+  ReplayWriter* recorder_;
+
+  bool logging_;
+  std::vector<Change> changes_;
+
+  // A clear that moves more rows than this marks the hash as stale
+  // rather than rehashing every row it moves.
+  static const int REHASH_ROWS = 64;
+
+  // The board is kept as two planes: words_ occupancy words per row,
+  // which is all that collision and row detection look at, and a byte
+  // per cell holding the colour index (-1 when empty) for get().
+  //
+  // Both planes live in stores of capacity_ rows, which grow with the
+  // stack up to the height of the well; rows above the stack are
+  // always zero.  A well too tall to be stored whole keeps a gap of
+  // gap_len_ unused rows in the stores, below row gap_: clearing a
+  // row moves the gap to it, moving just the rows between the last
+  // clear and this one, and widens it by a row, so the rows above
+  // come down without being moved at all.  Rows usually clear close
+  // to where the last ones did.  The gap closes again when the stack
+  // needs the room.  A well stored whole never has a gap.
+  int words_;
+  RowMask* rows_;
+  int capacity_;
+  int gap_;
+  int gap_len_;
+  // Each of the first live_rows_ rows, up to at least the top of the
+  // stack, has its own block of colour bytes, carved out of chunks of
+  // CHUNK_ROWS blocks, so removing a row only moves pointers.  The
+  // blocks of removed rows go back to a pool, and are cleared when they
+  // are next used.
+  signed char** colours_;
+  int live_rows_;
+  std::vector<signed char*> free_colours_;
+  std::vector<signed char*> colour_chunks_;
+  // The last word of a full row; every word before it is all ones.
+  RowMask full_row_;
+  mutable uint64_t board_hash_;
+  mutable bool hash_stale_;
+
+  // Incrementally maintained summaries of the locked cells: the
+  // height of the topmost filled cell in each column, and the height
+  // of the whole stack.
+  int* heights_;
+
+  // A single piece spans at most four rows, so at most four rows can
+  // fill at once.  full_ holds the rows filled by the last piece
+  // placed, waiting for collapse(); cleared_ the rows it removed.
+  int full_[4];
+  int num_full_;
+  int cleared_[4];
+  int num_cleared_;
+
+  int stack_height_;
+};
+
+// Everything needed to put a game back exactly as it was, as a plain
+// value: copying one is a memcpy and never allocates, so search, undo
+// and checkpointing can take as many as they like.  Cells are packed
+// into a 16-bit occupancy word and a 64-bit word of 4-bit colours per
+// row, which keeps a standard 10x20 game to a few cache lines.
+struct GameState
+{
+  static const int MAX_WIDTH = 16;
+  static const int MAX_ROWS = 28;
+
+  // Whether a well of the given dimensions can be saved.
+  static bool fits(int width, int height)
+  {
+    return width <= MAX_WIDTH && height + 4 <= MAX_ROWS;
+  }
+
+  // The locked cells: bit c of rows[r] is set when cell (r,c) is
+  // filled, and nibble c of colours[r] holds its colour index plus one.
+  uint16_t rows[ MAX_ROWS ];
+  uint64_t colours[ MAX_ROWS ];
+
+  Random rng;
+  uint64_t seed;
+  int64_t piece_count;
+  int64_t line_count;
+
+  uint8_t width;
+  uint8_t height;
+  uint8_t randomizer;
+  uint8_t stopped;
+
+  // The falling piece and its anchor.
+  uint8_t piece;
+  uint8_t rotation;
+  int8_t x;
+  int8_t y;
+
+  uint8_t bag[ NUM_PIECES ];
+  uint8_t bag_pos;
+  uint8_t queue[ Game::PREVIEW_SIZE ];
+  uint8_t queue_head;
 
-  int* board_;
+  uint8_t num_cleared;
+  uint8_t cleared[4];
 };
 
 #endif // CS488_GAME_HPP
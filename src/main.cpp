@@ -10,8 +10,9 @@ int main(int argc, char** argv)
   // Initialize OpenGL
   Gtk::GL::init(argc, argv);
 
-  // Construct our (only) window
-  AppWindow window;
+  // Construct our (only) window.  Any argument left over once gtk
+  // has taken its own is a file to record games to.
+  AppWindow window( argc > 1 ? argv[1] : NULL );
 
   // And run the application!
   Gtk::Main::run(window);
@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include "mesher.hpp"
+
+BoardMesher::BoardMesher()
+  : width_(0)
+  , height_(0)
+  , all_(true)
+{}
+
+void BoardMesher::mark(int first, int last)
+{
+  first = std::max(first, 0);
+  last = std::min(last, int(dirty_.size()) - 1);
+  for(int r = first; r <= last; ++r) {
+    dirty_[r] = 1;
+  }
+}
+
+void BoardMesher::apply(const std::vector<Game::Change>& changes)
+{
+  for(size_t i = 0; i < changes.size(); ++i) {
+    const Game::Change& change = changes[i];
+
+    switch(change.type) {
+    case Game::Change::RESET:
+      all_ = true;
+      break;
+
+    case Game::Change::PIECE_LOCKED:
+      // The piece's rows, and the rows either side whose top and
+      // bottom faces it may now cover.
+      mark(change.y - 4, change.y + 1);
+      break;
+
+    case Game::Change::ROW_REMOVED:
+      // The faces of every row above move down with it.  Only the rows
+      // that now meet across the gap look different.
+      if(!all_ && change.y < int(rows_.size())) {
+        rows_.erase(rows_.begin() + change.y);
+        rows_.push_back(std::vector<Face>());
+        dirty_.erase(dirty_.begin() + change.y);
+        dirty_.push_back(1);
+        mark(change.y - 1, change.y);
+      }
+      break;
+
+    default:
+      // The falling piece isn't part of the mesh.
+      break;
+    }
+  }
+}
+
+bool BoardMesher::update(const Game& game)
+{
+  if(game.getWidth() != width_ || game.getHeight() != height_) {
+    width_ = game.getWidth();
+    height_ = game.getHeight();
+    all_ = true;
+  }
+
+  if(all_) {
+    rows_.assign(height_ + 4, std::vector<Face>());
+    dirty_.assign(height_ + 4, 1);
+    all_ = false;
+  }
+
+  bool changed = false;
+  for(int r = 0; r < int(rows_.size()); ++r) {
+    if(dirty_[r]) {
+      buildRow(game, r);
+      dirty_[r] = 0;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+long BoardMesher::getFaceCount() const
+{
+  long count = 0;
+  for(size_t r = 0; r < rows_.size(); ++r) {
+    count += rows_[r].size();
+  }
+  return count;
+}
+
+template<class Exposed>
+void BoardMesher::addRuns(const Game& game, int r, Side side,
+                          Exposed exposed)
+{
+  std::vector<Face>& faces = rows_[r];
+
+  for(int c = 0; c < width_; ) {
+    int colour = game.getLocked(r, c);
+    if(colour < 0 || !exposed(c)) {
+      ++c;
+      continue;
+    }
+
+    int end = c + 1;
+    while(end < width_ && game.getLocked(r, end) == colour &&
+          exposed(end)) {
+      ++end;
+    }
+
+    Face face = { uint8_t(side), int8_t(colour), int16_t(c),
+                  int16_t(end - c) };
+    faces.push_back(face);
+    c = end;
+  }
+}
+
+void BoardMesher::buildRow(const Game& game, int r)
+{
+  rows_[r].clear();
+
+  int rows = rows_.size();
+  addRuns(game, r, FRONT, [](int) { return true; });
+  addRuns(game, r, BACK, [](int) { return true; });
+  addRuns(game, r, TOP, [&](int c) {
+    return r + 1 >= rows || game.getLocked(r + 1, c) < 0;
+  });
+  // The bottom row sits on the floor of the well.
+  addRuns(game, r, BOTTOM, [&](int c) {
+    return r > 0 && game.getLocked(r - 1, c) < 0;
+  });
+
+  // The sides of cells in a row are all in different planes, so are
+  // never merged.  The outermost ones are against the walls.
+  std::vector<Face>& faces = rows_[r];
+  for(int c = 0; c < width_; ++c) {
+    int colour = game.getLocked(r, c);
+    if(colour < 0) {
+      continue;
+    }
+    if(c > 0 && game.getLocked(r, c - 1) < 0) {
+      Face face = { uint8_t(LEFT), int8_t(colour), int16_t(c), 1 };
+      faces.push_back(face);
+    }
+    if(c + 1 < width_ && game.getLocked(r, c + 1) < 0) {
+      Face face = { uint8_t(RIGHT), int8_t(colour), int16_t(c), 1 };
+      faces.push_back(face);
+    }
+  }
+}
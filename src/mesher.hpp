@@ -0,0 +1,81 @@
+#ifndef CS488_MESHER_HPP
+#define CS488_MESHER_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "game.hpp"
+
+// Turns the locked cells of a game into the faces that can actually be
+// seen.  A face between two filled cells is never drawn, and neither is
+// one against the walls or the floor of the well, which are drawn over
+// it.  Along each row, the front, back, top and bottom faces of cells of
+// the same colour are merged into one long face.
+//
+// Faces are kept row by row, and each row only depends on itself and
+// the rows either side of it, so after a piece locks only the rows
+// around it are looked at again, and removing a row just drops its
+// faces.  Feed the mesher the game's change log with apply(), and it
+// works out which rows to redo the next time update() is called.
+class BoardMesher
+{
+public:
+  // The sides of a cube, in the order Viewer::drawCube() draws them.
+  enum Side {
+    FRONT,
+    BACK,
+    TOP,
+    BOTTOM,
+    LEFT,
+    RIGHT,
+    NUM_SIDES
+  };
+
+  // A face of width cells starting at column x, of the row it is kept
+  // in, on the given side of the cells, which hold the given colour
+  // index.
+  struct Face
+  {
+    uint8_t side;
+    int8_t colour;
+    int16_t x;
+    int16_t width;
+  };
+
+  BoardMesher();
+
+  // Note which rows the given changes affect.
+  void apply(const std::vector<Game::Change>& changes);
+
+  // Rebuild the rows that need it from the locked cells of game, or
+  // every row if game isn't the size the mesher was last used for.
+  // Returns whether any row was rebuilt.
+  bool update(const Game& game);
+
+  int getRowCount() const
+  {
+    return rows_.size();
+  }
+  const std::vector<Face>& getRow(int r) const
+  {
+    return rows_[r];
+  }
+  // The total number of faces in every row.
+  long getFaceCount() const;
+
+private:
+  void mark(int first, int last);
+  void buildRow(const Game& game, int r);
+  // Add runs of the cells of row r for which exposed says the given
+  // side can be seen.
+  template<class Exposed>
+  void addRuns(const Game& game, int r, Side side, Exposed exposed);
+
+  int width_;
+  int height_;
+  bool all_;
+  std::vector<std::vector<Face> > rows_;
+  std::vector<char> dirty_;
+};
+
+#endif // CS488_MESHER_HPP
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cassert>
+
+#include "placement.hpp"
+
+PlacementFinder::PlacementFinder()
+  : xspan_(0)
+  , yspan_(0)
+  , tail_(0)
+  , num_found_(0)
+{}
+
+bool PlacementFinder::push(const Game::RowMask* rows, int width,
+                           const Piece& p, int x, int y, int from, Move move)
+{
+  int i = index(x, y, p.getRotation());
+
+  if(test(visited_, i) || !Game::pieceFits(rows, width, p, x, y)) {
+    return false;
+  }
+
+  set(visited_, i);
+  parent_[i] = from;
+  move_[i] = move;
+
+  State& s = queue_[ tail_++ ];
+  s.x = x;
+  s.y = y;
+  s.rotation = p.getRotation();
+  return true;
+}
+
+void PlacementFinder::emit(int state, std::vector<Placement>& out)
+{
+  int x = state % xspan_ - 3;
+  int y = state / xspan_ % yspan_;
+  int rotation = state / (xspan_ * yspan_);
+
+  const PieceOrientation& o = Piece(piece_.getId(), rotation).orientation();
+  int canonical = index(x + o.canonical_dx, y + o.canonical_dy, o.canonical);
+  if(test(emitted_, canonical)) {
+    return;
+  }
+  set(emitted_, canonical);
+
+  // Recycle placements from earlier searches, so their paths keep the
+  // storage they already have.
+  if(num_found_ == int(out.size())) {
+    if(spare_.empty()) {
+      out.push_back(Placement());
+    } else {
+      out.push_back(std::move(spare_.back()));
+      spare_.pop_back();
+    }
+  }
+  Placement& p = out[ num_found_++ ];
+
+  p.x = x;
+  p.y = y;
+  p.rotation = rotation;
+  p.path.clear();
+  for(int s = state; parent_[s] >= 0; s = parent_[s]) {
+    p.path.push_back(Move(move_[s]));
+  }
+  std::reverse(p.path.begin(), p.path.end());
+}
+
+int PlacementFinder::landing(const Game::RowMask* rows, int width,
+                             const Piece& p, int x, int y) const
+{
+  // As in Game::dropDistance(): the piece meets the surface unless it
+  // is under an overhang, in which case it has to be stepped down.
+  int ly = 3 - p.getBottomMargin();
+
+  for(int c = p.getLeftMargin(); c < 4 - p.getRightMargin(); ++c) {
+    int b = y - p.getColumnBottom(c);
+    int h = heights_[ x+c ];
+
+    if(b < h) {
+      ly = y;
+      while(Game::pieceFits(rows, width, p, x, ly - 1)) {
+        --ly;
+      }
+      return ly;
+    }
+
+    ly = std::max(ly, h + p.getColumnBottom(c));
+  }
+
+  return ly;
+}
+
+void PlacementFinder::find(const Game::RowMask* rows, int width, int height,
+                           const Piece& piece, int x, int y,
+                           std::vector<Placement>& out, Mode mode)
+{
+  assert(width <= 64);
+
+  xspan_ = width + 3;
+  yspan_ = height + 4;
+  piece_ = piece;
+  num_found_ = 0;
+
+  int states = NUM_ROTATIONS * xspan_ * yspan_;
+  visited_.assign((states + 63) / 64, 0);
+  emitted_.assign((states + 63) / 64, 0);
+  parent_.resize(states);
+  move_.resize(states);
+  queue_.resize(states);
+
+  if(!Game::pieceFits(rows, width, piece, x, y)) {
+    while(!out.empty()) {
+      spare_.push_back(std::move(out.back()));
+      out.pop_back();
+    }
+    return;
+  }
+
+  std::fill(heights_, heights_ + width, 0);
+  Game::RowMask seen = 0;
+  for(int r = height + 3; r >= 0; --r) {
+    Game::RowMask fresh = rows[r] & ~seen;
+    for(; fresh != 0; fresh &= fresh - 1) {
+      heights_[ __builtin_ctzll(fresh) ] = r + 1;
+    }
+    seen |= rows[r];
+  }
+
+  int head = 0;
+  int start = index(x, y, piece.getRotation());
+
+  set(visited_, start);
+  parent_[start] = -1;
+  queue_[0].x = x;
+  queue_[0].y = y;
+  queue_[0].rotation = piece.getRotation();
+  tail_ = 1;
+
+  while(head < tail_) {
+    const State st = queue_[head++];
+    Piece p(piece.getId(), st.rotation);
+    int s = index(st.x, st.y, st.rotation);
+
+    push(rows, width, p, st.x - 1, st.y, s, MOVE_LEFT);
+    push(rows, width, p, st.x + 1, st.y, s, MOVE_RIGHT);
+    push(rows, width, p.rotateCW(), st.x, st.y, s, MOVE_ROTATE_CW);
+    push(rows, width, p.rotateCCW(), st.x, st.y, s, MOVE_ROTATE_CCW);
+
+    if(!Game::pieceFits(rows, width, p, st.x, st.y - 1)) {
+      // Resting already; the next tick would lock it here.
+      emit(s, out);
+      continue;
+    }
+
+    if(mode == ALL_MOVES) {
+      push(rows, width, p, st.x, st.y - 1, s, MOVE_DOWN);
+    }
+
+    // Moving down a row at a time reaches everywhere a drop does, so
+    // drops are only tried from the starting row, which keeps the paths
+    // short without a drop search from every state.
+    if(st.y == y) {
+      int ly = landing(rows, width, p, st.x, st.y);
+
+      if(mode == ALL_MOVES) {
+        push(rows, width, p, st.x, ly, s, MOVE_DROP);
+      } else if(!test(visited_, index(st.x, ly, st.rotation))) {
+        // Dropped pieces are not moved again.
+        int l = index(st.x, ly, st.rotation);
+        set(visited_, l);
+        parent_[l] = s;
+        move_[l] = MOVE_DROP;
+        emit(l, out);
+      }
+    }
+  }
+
+  while(int(out.size()) > num_found_) {
+    spare_.push_back(std::move(out.back()));
+    out.pop_back();
+  }
+}
@@ -0,0 +1,87 @@
+#ifndef CS488_PLACEMENT_HPP
+#define CS488_PLACEMENT_HPP
+
+#include <vector>
+
+#include "game.hpp"
+
+// Finds every place a piece can reach on a board and come to rest, by
+// a breadth-first search over (x, y, rotation) states, using the same
+// collision test as Game.  Placements that cover exactly the same cells
+// in different orientations (the square, for instance) are reported
+// once.  The search buffers are kept between calls, so one finder can
+// be reused for many searches without allocating.
+class PlacementFinder
+{
+public:
+  // ALL_MOVES follows every legal move, including sliding or rotating a
+  // piece in under an overhang.  DROP_ONLY only shifts and rotates the
+  // piece where it starts and then drops it, which is far cheaper and
+  // is all that most bots look at.
+  enum Mode {
+    ALL_MOVES,
+    DROP_ONLY
+  };
+
+  PlacementFinder();
+
+  // Search a board of the given width (at most 64) and height (plus
+  // the usual four extra rows) whose locked cells are given by rows,
+  // one word to a row, for a piece starting with its anchor at (x,y).
+  // The placements found replace the contents of out; each one's path
+  // starts from (x,y).
+  void find(const Game::RowMask* rows, int width, int height,
+            const Piece& piece, int x, int y,
+            std::vector<Placement>& out, Mode mode = ALL_MOVES);
+
+private:
+  int index(int x, int y, int rotation) const
+  {
+    return (rotation * yspan_ + y) * xspan_ + (x + 3);
+  }
+
+  static bool test(const std::vector<uint64_t>& bits, int i)
+  {
+    return (bits[ i >> 6 ] >> (i & 63)) & 1;
+  }
+  static void set(std::vector<uint64_t>& bits, int i)
+  {
+    bits[ i >> 6 ] |= uint64_t(1) << (i & 63);
+  }
+
+  // Queue piece p at (x,y), reached from state from by the given move,
+  // unless it has been seen already or doesn't fit.
+  bool push(const Game::RowMask* rows, int width, const Piece& p,
+            int x, int y, int from, Move move);
+
+  void emit(int state, std::vector<Placement>& out);
+
+  // The row the piece at (x,y) lands on if dropped.
+  int landing(const Game::RowMask* rows, int width, const Piece& p,
+              int x, int y) const;
+
+  // Columns run from -3 (a piece hanging off the left edge of its box)
+  // to width-1, and rows from 0 to height+3.
+  int xspan_;
+  int yspan_;
+
+  Piece piece_;
+  // The height of each column's topmost locked cell.
+  int heights_[64];
+  std::vector<uint64_t> visited_;
+  std::vector<uint64_t> emitted_;
+  std::vector<int> parent_;
+  std::vector<unsigned char> move_;
+  struct State {
+    int x;
+    int y;
+    int rotation;
+  };
+
+  std::vector<State> queue_;
+  int tail_;
+  int num_found_;
+  std::vector<Placement> spare_;
+};
+
+#endif // CS488_PLACEMENT_HPP
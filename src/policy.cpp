@@ -0,0 +1,110 @@
+#include <cstring>
+
+#include "policy.hpp"
+
+Policy::~Policy()
+{}
+
+void Policy::seed(unsigned /*s*/)
+{}
+
+const char* DropPolicy::getName() const
+{
+  return "drop";
+}
+
+void DropPolicy::play(Game& /*game*/)
+{}
+
+RandomPolicy::RandomPolicy(unsigned seed)
+  : state_(seed)
+{}
+
+const char* RandomPolicy::getName() const
+{
+  return "random";
+}
+
+void RandomPolicy::seed(unsigned s)
+{
+  state_ = s;
+}
+
+unsigned RandomPolicy::next()
+{
+  // A plain LCG is plenty for picking moves, and keeps each policy's
+  // choices independent of every other.
+  state_ = state_ * 1103515245u + 12345u;
+  return state_ >> 16;
+}
+
+void RandomPolicy::play(Game& game)
+{
+  int rotations = next() % NUM_ROTATIONS;
+  int shift = int(next() % game.getWidth()) - game.getWidth() / 2;
+
+  for(int i = 0; i < rotations; ++i) {
+    game.rotateCW();
+  }
+
+  for(; shift < 0; ++shift) {
+    if(!game.moveLeft()) {
+      break;
+    }
+  }
+  for(; shift > 0; --shift) {
+    if(!game.moveRight()) {
+      break;
+    }
+  }
+}
+
+const char* AIPolicy::getName() const
+{
+  return "ai";
+}
+
+void AIPolicy::play(Game& game)
+{
+  if(player_.choose(game, placement_)) {
+    for(size_t i = 0; i < placement_.path.size(); ++i) {
+      game.apply(placement_.path[i]);
+    }
+  }
+}
+
+BeamPolicy::BeamPolicy(const BeamSearch::Options& options)
+  : search_(options)
+{}
+
+const char* BeamPolicy::getName() const
+{
+  return "beam";
+}
+
+void BeamPolicy::play(Game& game)
+{
+  if(search_.choose(game, placement_)) {
+    for(size_t i = 0; i < placement_.path.size(); ++i) {
+      game.apply(placement_.path[i]);
+    }
+  }
+}
+
+Policy* createPolicy(const char* name, unsigned seed,
+                     const BeamSearch::Options& search)
+{
+  if(std::strcmp(name, "drop") == 0) {
+    return new DropPolicy();
+  }
+  if(std::strcmp(name, "random") == 0) {
+    return new RandomPolicy(seed);
+  }
+  if(std::strcmp(name, "ai") == 0) {
+    return new AIPolicy();
+  }
+  if(std::strcmp(name, "beam") == 0) {
+    return new BeamPolicy(search);
+  }
+  return NULL;
+}
@@ -0,0 +1,83 @@
+#ifndef CS488_POLICY_HPP
+#define CS488_POLICY_HPP
+
+#include "ai.hpp"
+#include "game.hpp"
+#include "search.hpp"
+
+// A move policy decides where each new piece should go.  The
+// simulator calls play() once for every piece, as soon as it appears
+// at the top of the well; the policy makes whatever moves it likes,
+// and the simulator then drops the piece and locks it in.
+class Policy
+{
+public:
+  virtual ~Policy();
+
+  virtual const char* getName() const = 0;
+
+  // Restart any random choices the policy makes from the given seed.
+  virtual void seed(unsigned s);
+
+  virtual void play(Game& game) = 0;
+};
+
+// Leaves every piece where it spawned.
+class DropPolicy : public Policy
+{
+public:
+  virtual const char* getName() const;
+  virtual void play(Game& game);
+};
+
+// Rotates each piece a random number of times and slides it towards a
+// random column.
+class RandomPolicy : public Policy
+{
+public:
+  RandomPolicy(unsigned seed);
+
+  virtual const char* getName() const;
+  virtual void seed(unsigned s);
+  virtual void play(Game& game);
+
+private:
+  unsigned next();
+
+  unsigned state_;
+};
+
+// Lets an AIPlayer choose where each piece goes.
+class AIPolicy : public Policy
+{
+public:
+  virtual const char* getName() const;
+  virtual void play(Game& game);
+
+private:
+  AIPlayer player_;
+  Placement placement_;
+};
+
+// Lets a BeamSearch choose where each piece goes, looking ahead
+// through the preview queue.
+class BeamPolicy : public Policy
+{
+public:
+  explicit BeamPolicy(const BeamSearch::Options& options);
+
+  virtual const char* getName() const;
+  virtual void play(Game& game);
+
+private:
+  BeamSearch search_;
+  Placement placement_;
+};
+
+// Create the policy with the given name, or return NULL if there is
+// no such policy.  The search options are only used by "beam".
+Policy* createPolicy(const char* name, unsigned seed,
+                     const BeamSearch::Options& search =
+                       BeamSearch::DEFAULT_OPTIONS);
+
+#endif // CS488_POLICY_HPP
@@ -0,0 +1,65 @@
+#ifndef CS488_RANDOM_HPP
+#define CS488_RANDOM_HPP
+
+#include <stdint.h>
+
+// A small, fast pseudo-random generator (xoshiro128**).  Its whole
+// state is four words, so it can be copied along with a game and
+// always replays the same sequence from the same seed.
+class Random
+{
+public:
+  Random()
+  {
+    seed(0);
+  }
+  explicit Random(uint64_t s)
+  {
+    seed(s);
+  }
+
+  // The state is filled in from the seed with splitmix64, which never
+  // leaves it all zero.
+  void seed(uint64_t s)
+  {
+    for(int i = 0; i < 4; i += 2) {
+      uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      z ^= z >> 31;
+      s_[i] = uint32_t(z);
+      s_[i+1] = uint32_t(z >> 32);
+    }
+  }
+
+  uint32_t next()
+  {
+    uint32_t result = rotl(s_[1] * 5, 7) * 9;
+    uint32_t t = s_[1] << 9;
+
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 11);
+
+    return result;
+  }
+
+  // A value in [0, n), by scaling rather than taking a remainder.
+  uint32_t below(uint32_t n)
+  {
+    return uint32_t((uint64_t(next()) * n) >> 32);
+  }
+
+private:
+  static uint32_t rotl(uint32_t x, int k)
+  {
+    return (x << k) | (x >> (32 - k));
+  }
+
+  uint32_t s_[4];
+};
+
+#endif // CS488_RANDOM_HPP
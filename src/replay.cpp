@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#include "replay.hpp"
+
+namespace {
+
+const char MAGIC[4] = { 'R', '4', '8', '8' };
+const char INDEX_MAGIC[4] = { 'X', '4', '8', '8' };
+
+// The offset of the index and the magic number again.
+const int FOOTER_SIZE = 12;
+
+}
+
+ReplayWriter::ReplayWriter()
+  : file_(NULL)
+  , ok_(true)
+  , recording_(false)
+  , ticks_(0)
+  , game_ticks_(0)
+  , interval_(Replay::KEYFRAME_INTERVAL)
+  , next_keyframe_(ULONG_MAX)
+  , buffer_(new uint8_t[ Replay::BUFFER_SIZE ])
+  , used_(0)
+  , written_(0)
+{}
+
+ReplayWriter::~ReplayWriter()
+{
+  close();
+  delete [] buffer_;
+}
+
+bool ReplayWriter::open(const char* path)
+{
+  close();
+
+  file_ = std::fopen(path, "wb");
+  ok_ = file_ != NULL;
+  written_ = 0;
+  index_.clear();
+  return ok_;
+}
+
+bool ReplayWriter::close()
+{
+  if(file_ == NULL) {
+    return true;
+  }
+
+  if(recording_) {
+    // The game never got to finish, so it ends with whatever it had.
+    putEvent(Replay::OP_END);
+    putVarint(0);
+    putVarint(0);
+    recording_ = false;
+  }
+
+  if(!index_.empty()) {
+    writeIndex();
+  }
+
+  flush();
+  if(std::fclose(file_) != 0) {
+    ok_ = false;
+  }
+  file_ = NULL;
+  return ok_;
+}
+
+void ReplayWriter::beginGame(const Game& game)
+{
+  if(file_ == NULL) {
+    return;
+  }
+
+  GameEntry entry;
+  entry.offset = getBytesWritten();
+  index_.push_back(entry);
+
+  for(int i = 0; i < 4; ++i) {
+    put(MAGIC[i]);
+  }
+  put(Replay::VERSION);
+  putVarint(game.getWidth());
+  putVarint(game.getHeight());
+  put(game.getRandomizer());
+
+  uint64_t seed = game.getSeed();
+  for(int i = 0; i < 8; ++i) {
+    put(uint8_t(seed >> (8*i)));
+  }
+
+  ticks_ = 0;
+  game_ticks_ = 0;
+  next_keyframe_ = interval_ > 0 &&
+                   GameState::fits(game.getWidth(), game.getHeight())
+                   ? interval_ : ULONG_MAX;
+  recording_ = true;
+}
+
+void ReplayWriter::endGame(const Game& game)
+{
+  if(!recording_) {
+    return;
+  }
+
+  putEvent(Replay::OP_END);
+  putVarint(game.getPieceCount());
+  putVarint(game.getLineCount());
+  recording_ = false;
+  next_keyframe_ = ULONG_MAX;
+}
+
+void ReplayWriter::keyframe(const Game& game)
+{
+  next_keyframe_ += interval_;
+  if(!recording_) {
+    return;
+  }
+
+  KeyframeEntry entry;
+  entry.tick = game_ticks_;
+  entry.offset = getBytesWritten();
+  index_.back().keyframes.push_back(entry);
+
+  GameState state;
+  game.save(state);
+
+  putEvent(Replay::OP_KEYFRAME);
+  putVarint(game_ticks_);
+  putVarint(sizeof(state));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&state);
+  for(size_t i = 0; i < sizeof(state); ++i) {
+    put(bytes[i]);
+  }
+}
+
+void ReplayWriter::writeIndex()
+{
+  uint64_t offset = getBytesWritten();
+
+  for(int i = 0; i < 4; ++i) {
+    put(INDEX_MAGIC[i]);
+  }
+  putVarint(index_.size());
+
+  long previous = 0;
+  for(size_t g = 0; g < index_.size(); ++g) {
+    const GameEntry& game = index_[g];
+    putVarint(game.offset - previous);
+    putVarint(game.keyframes.size());
+    previous = game.offset;
+
+    unsigned long tick = 0;
+    long at = game.offset;
+    for(size_t k = 0; k < game.keyframes.size(); ++k) {
+      putVarint(game.keyframes[k].tick - tick);
+      putVarint(game.keyframes[k].offset - at);
+      tick = game.keyframes[k].tick;
+      at = game.keyframes[k].offset;
+    }
+  }
+
+  for(int i = 0; i < 8; ++i) {
+    put(uint8_t(offset >> (8*i)));
+  }
+  for(int i = 0; i < 4; ++i) {
+    put(MAGIC[i]);
+  }
+  index_.clear();
+}
+
+void ReplayWriter::input(Move move)
+{
+  if(recording_) {
+    putEvent(move);
+  }
+}
+
+void ReplayWriter::putVarint(uint64_t value)
+{
+  while(value >= 0x80) {
+    put(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  put(uint8_t(value));
+}
+
+void ReplayWriter::putEvent(int opcode)
+{
+  if(ticks_ < Replay::DELTA_ESCAPE) {
+    put(uint8_t((opcode << Replay::DELTA_BITS) | ticks_));
+  } else {
+    put(uint8_t((opcode << Replay::DELTA_BITS) | Replay::DELTA_ESCAPE));
+    putVarint(ticks_ - Replay::DELTA_ESCAPE);
+  }
+  ticks_ = 0;
+}
+
+void ReplayWriter::flush()
+{
+  if(used_ > 0 && file_ != NULL &&
+     std::fwrite(buffer_, 1, used_, file_) != size_t(used_)) {
+    ok_ = false;
+  }
+  written_ += used_;
+  used_ = 0;
+}
+
+ReplayReader::ReplayReader()
+  : file_(NULL)
+  , buffer_(new uint8_t[ Replay::BUFFER_SIZE ])
+  , size_(0)
+  , pos_(0)
+  , offset_(0)
+  , tick_(0)
+  , pending_(false)
+  , indexed_(false)
+{}
+
+ReplayReader::~ReplayReader()
+{
+  close();
+  delete [] buffer_;
+}
+
+bool ReplayReader::open(const char* path)
+{
+  close();
+
+  file_ = std::fopen(path, "rb");
+  size_ = 0;
+  pos_ = 0;
+  offset_ = 0;
+  tick_ = 0;
+  pending_ = false;
+  indexed_ = false;
+  games_.clear();
+  first_keyframe_.clear();
+  keyframe_ticks_.clear();
+  keyframe_offsets_.clear();
+  return file_ != NULL;
+}
+
+void ReplayReader::close()
+{
+  if(file_ != NULL) {
+    std::fclose(file_);
+    file_ = NULL;
+  }
+}
+
+bool ReplayReader::refill()
+{
+  if(file_ == NULL) {
+    return false;
+  }
+
+  offset_ += size_;
+  pos_ = 0;
+  size_ = std::fread(buffer_, 1, Replay::BUFFER_SIZE, file_);
+  return size_ > 0;
+}
+
+bool ReplayReader::seekTo(long offset)
+{
+  if(file_ == NULL || std::fseek(file_, offset, SEEK_SET) != 0) {
+    return false;
+  }
+
+  offset_ = offset;
+  size_ = 0;
+  pos_ = 0;
+  return true;
+}
+
+bool ReplayReader::getVarint(uint64_t& value)
+{
+  value = 0;
+  for(int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if(!get(byte)) {
+      return false;
+    }
+    value |= uint64_t(byte & 0x7f) << shift;
+    if(!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ReplayReader::nextGame(Header& header)
+{
+  uint8_t magic[4];
+  for(int i = 0; i < 4; ++i) {
+    if(!get(magic[i])) {
+      return false;
+    }
+  }
+  if(std::memcmp(magic, MAGIC, 4) != 0) {
+    return false;
+  }
+
+  uint8_t version;
+  uint64_t width;
+  uint64_t height;
+  uint8_t randomizer;
+  if(!get(version) || version < 1 || version > Replay::VERSION ||
+     !getVarint(width) || !getVarint(height) || !get(randomizer) ||
+     width == 0 || width > Replay::MAX_SIZE || height == 0 ||
+     height > Replay::MAX_SIZE || randomizer > Game::BAG) {
+    return false;
+  }
+
+  uint64_t seed = 0;
+  for(int i = 0; i < 8; ++i) {
+    uint8_t byte;
+    if(!get(byte)) {
+      return false;
+    }
+    seed |= uint64_t(byte) << (8*i);
+  }
+
+  header.width = width;
+  header.height = height;
+  header.randomizer = Game::Randomizer(randomizer);
+  header.seed = seed;
+  return true;
+}
+
+bool ReplayReader::next(Event& event)
+{
+  uint8_t byte;
+  if(!get(byte)) {
+    return false;
+  }
+
+  int opcode = byte >> Replay::DELTA_BITS;
+  event.ticks = byte & Replay::DELTA_ESCAPE;
+  if(event.ticks == Replay::DELTA_ESCAPE) {
+    uint64_t more;
+    if(!getVarint(more)) {
+      return false;
+    }
+    event.ticks += more;
+  }
+
+  if(opcode == Replay::OP_END) {
+    uint64_t pieces;
+    uint64_t lines;
+    if(!getVarint(pieces) || !getVarint(lines)) {
+      return false;
+    }
+    event.type = Event::END;
+    event.pieces = pieces;
+    event.lines = lines;
+    return true;
+  }
+
+  if(opcode == Replay::OP_KEYFRAME) {
+    uint64_t tick;
+    uint64_t size;
+    if(!getVarint(tick) || !getVarint(size) ||
+       size != sizeof(event.state)) {
+      return false;
+    }
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(&event.state);
+    for(size_t i = 0; i < sizeof(event.state); ++i) {
+      if(!get(bytes[i])) {
+        return false;
+      }
+    }
+    event.type = Event::KEYFRAME;
+    event.tick = tick;
+    return true;
+  }
+
+  event.type = Event::INPUT;
+  event.move = Move(opcode);
+  return true;
+}
+
+void ReplayReader::start(const Header& header, Game& game)
+{
+  game.seed(header.seed);
+  game.setRandomizer(header.randomizer);
+  game.reset();
+  tick_ = 0;
+  pending_ = false;
+}
+
+bool ReplayReader::playTo(Game& game, unsigned long tick)
+{
+  for(;;) {
+    if(!pending_) {
+      if(!next(event_)) {
+        return false;
+      }
+      pending_ = true;
+    }
+
+    for(; event_.ticks > 0; --event_.ticks) {
+      if(tick_ == tick) {
+        return true;
+      }
+      game.tick();
+      ++tick_;
+    }
+
+    switch(event_.type) {
+    case Event::END:
+      // Leave the end for play() to check.
+      return true;
+    case Event::KEYFRAME:
+      if(event_.tick != tick_) {
+        return false;
+      }
+      break;
+    case Event::INPUT:
+      // Only moves that worked were recorded, so they all must again.
+      if(!game.apply(event_.move)) {
+        return false;
+      }
+      break;
+    }
+    pending_ = false;
+  }
+}
+
+bool ReplayReader::play(Game& game)
+{
+  if(!playTo(game, ULONG_MAX) || event_.type != Event::END) {
+    return false;
+  }
+  pending_ = false;
+
+  // A game cut off before it finished was written with no counts.
+  return (event_.pieces == 0 && event_.lines == 0) ||
+         (event_.pieces == game.getPieceCount() &&
+          event_.lines == game.getLineCount());
+}
+
+bool ReplayReader::loadIndex()
+{
+  if(file_ == NULL) {
+    return false;
+  }
+
+  // Reading the index mustn't disturb reading the games in order.
+  long resume = getBytesRead();
+
+  uint8_t footer[ FOOTER_SIZE ];
+  if(std::fseek(file_, -FOOTER_SIZE, SEEK_END) != 0 ||
+     std::fread(footer, 1, FOOTER_SIZE, file_) != size_t(FOOTER_SIZE) ||
+     std::memcmp(footer + 8, MAGIC, 4) != 0) {
+    seekTo(resume);
+    return false;
+  }
+
+  uint64_t offset = 0;
+  for(int i = 0; i < 8; ++i) {
+    offset |= uint64_t(footer[i]) << (8*i);
+  }
+
+  bool ok = seekTo(offset);
+  uint8_t magic[4];
+  for(int i = 0; ok && i < 4; ++i) {
+    ok = get(magic[i]);
+  }
+  ok = ok && std::memcmp(magic, INDEX_MAGIC, 4) == 0;
+
+  uint64_t count = 0;
+  ok = ok && getVarint(count);
+
+  long game = 0;
+  for(uint64_t g = 0; ok && g < count; ++g) {
+    uint64_t delta;
+    uint64_t keyframes;
+    ok = getVarint(delta) && getVarint(keyframes);
+    game += delta;
+    games_.push_back(game);
+    first_keyframe_.push_back(keyframe_ticks_.size());
+
+    unsigned long tick = 0;
+    long at = game;
+    for(uint64_t k = 0; ok && k < keyframes; ++k) {
+      uint64_t dtick;
+      uint64_t doffset;
+      ok = getVarint(dtick) && getVarint(doffset);
+      tick += dtick;
+      at += doffset;
+      keyframe_ticks_.push_back(tick);
+      keyframe_offsets_.push_back(at);
+    }
+  }
+  first_keyframe_.push_back(keyframe_ticks_.size());
+
+  seekTo(resume);
+  if(!ok) {
+    games_.clear();
+    first_keyframe_.clear();
+    keyframe_ticks_.clear();
+    keyframe_offsets_.clear();
+    return false;
+  }
+  indexed_ = true;
+  return true;
+}
+
+long ReplayReader::getGameCount()
+{
+  if(!indexed_ && !loadIndex()) {
+    return -1;
+  }
+  return games_.size();
+}
+
+bool ReplayReader::seek(long index, unsigned long tick, Game*& game)
+{
+  if(!indexed_ && !loadIndex()) {
+    return false;
+  }
+  if(index < 0 || index >= long(games_.size())) {
+    return false;
+  }
+
+  Header header;
+  if(!seekTo(games_[index]) || !nextGame(header)) {
+    return false;
+  }
+  if(game == NULL || game->getWidth() != header.width ||
+     game->getHeight() != header.height) {
+    delete game;
+    game = new Game(header.width, header.height);
+  }
+  start(header, *game);
+
+  // Start from the last keyframe at or before the tick, if there is
+  // one; otherwise from the start of the game.
+  std::vector<unsigned long>::const_iterator first =
+    keyframe_ticks_.begin() + first_keyframe_[index];
+  std::vector<unsigned long>::const_iterator last =
+    keyframe_ticks_.begin() + first_keyframe_[index + 1];
+  std::vector<unsigned long>::const_iterator k =
+    std::upper_bound(first, last, tick);
+
+  if(k != first) {
+    long offset = keyframe_offsets_[ (k - keyframe_ticks_.begin()) - 1 ];
+    Event event;
+    if(!seekTo(offset) || !next(event) || event.type != Event::KEYFRAME) {
+      return false;
+    }
+    game->restore(event.state);
+    tick_ = event.tick;
+  }
+
+  return playTo(*game, tick);
+}
@@ -0,0 +1,303 @@
+#ifndef CS488_REPLAY_HPP
+#define CS488_REPLAY_HPP
+
+#include <cstdio>
+#include <stdint.h>
+#include <vector>
+
+#include "game.hpp"
+
+// Replays record games as the seed they were started from plus the
+// inputs made, each with the number of ticks since the one before.
+// Since a game is completely determined by its seed and its inputs,
+// that is enough to play it again exactly.
+//
+// A replay file holds any number of games one after another.  Each
+// game is a header:
+//
+//   "R488", version byte, width and height (varints), randomizer byte,
+//   seed (8 bytes, little-endian)
+//
+// followed by a stream of events, one byte each: an opcode in the top
+// three bits and a tick delta in the bottom five.  A delta of 31 means
+// the real delta, less 31, follows as a varint.  The opcodes are the
+// Move values for inputs, and END, which carries the ticks after the
+// last input and is followed by the number of pieces and rows of the
+// finished game as varints, to check a replay against.  Varints are
+// 7 bits a byte, low bits first.
+//
+// Every so many ticks the stream also holds a KEYFRAME: the number of
+// ticks played so far and the size of a GameState (varints), then the
+// whole GameState as it lies in memory.  Keyframes are only written
+// for wells that GameState can hold, and can only be read back on a
+// machine with the same layout.
+//
+// After the last game comes an index of where each game and each of
+// its keyframes starts:
+//
+//   "X488", the number of games, then for each game its offset (less
+//   the previous game's) and number of keyframes, and for each
+//   keyframe its tick and offset (less the previous one's, starting
+//   from the game's), all varints
+//
+// and the file ends with the offset of the index (8 bytes,
+// little-endian) and "R488" again.  Seeking to a tick restores the
+// keyframe before it and plays on from there, so it never takes more
+// than a keyframe interval of ticks however long the game is.
+//
+// A bot game that drops each piece comes to a few bytes a piece.
+namespace Replay {
+  const int VERSION = 2;
+
+  enum Opcode {
+    // 0-5 are the Move values.
+    OP_END = 6,
+    OP_KEYFRAME = 7
+  };
+
+  // The default number of ticks between keyframes.
+  const unsigned long KEYFRAME_INTERVAL = 4096;
+
+  // A header giving a well wider or taller than this is taken to be
+  // corrupt.
+  const uint64_t MAX_SIZE = 1 << 16;
+
+  const int DELTA_BITS = 5;
+  const unsigned DELTA_ESCAPE = (1u << DELTA_BITS) - 1;
+
+  // Inputs and finished games are written into a buffer of this size,
+  // and read back in blocks of it.
+  const int BUFFER_SIZE = 1 << 16;
+}
+
+// Writes replays.  Give a game a writer with Game::setRecorder() and
+// every tick and every successful input is recorded as it happens.
+class ReplayWriter
+{
+public:
+  ReplayWriter();
+  ~ReplayWriter();
+
+  // Open a replay file for writing, replacing anything already there.
+  // Returns false if the file can't be created.
+  bool open(const char* path);
+  // Finish off any game still being recorded, write the index and
+  // close the file.  Returns false if anything could not be written.
+  bool close();
+
+  // Write a keyframe every interval ticks, or never if it is 0.
+  void setKeyframeInterval(unsigned long interval)
+  {
+    interval_ = interval;
+  }
+
+  bool isOpen() const
+  {
+    return file_ != NULL;
+  }
+
+  // Start recording a game.  The game must just have been reset right
+  // after a seed() or setRandomizer(), so that it can be started the
+  // same way from the header.
+  void beginGame(const Game& game);
+  // Finish recording the game.
+  void endGame(const Game& game);
+
+  bool isRecording() const
+  {
+    return recording_;
+  }
+
+  // How many bytes have been written so far.
+  long getBytesWritten() const
+  {
+    return written_ + used_;
+  }
+
+  // Called by Game, before each tick is played.
+  void tick(const Game& game)
+  {
+    if(game_ticks_ == next_keyframe_) {
+      keyframe(game);
+    }
+    ++ticks_;
+    ++game_ticks_;
+  }
+  void input(Move move);
+
+private:
+  ReplayWriter(const ReplayWriter&);
+  ReplayWriter& operator=(const ReplayWriter&);
+
+  void put(uint8_t byte)
+  {
+    if(used_ == Replay::BUFFER_SIZE) {
+      flush();
+    }
+    buffer_[ used_++ ] = byte;
+  }
+  void putVarint(uint64_t value);
+  void putEvent(int opcode);
+  void flush();
+
+  void keyframe(const Game& game);
+  void writeIndex();
+
+  FILE* file_;
+  bool ok_;
+  bool recording_;
+  // Ticks since the last event written, and since the game began.
+  unsigned long ticks_;
+  unsigned long game_ticks_;
+  unsigned long interval_;
+  unsigned long next_keyframe_;
+  uint8_t* buffer_;
+  int used_;
+  long written_;
+
+  // Where each game and each keyframe starts, for the index.
+  struct KeyframeEntry
+  {
+    unsigned long tick;
+    long offset;
+  };
+  struct GameEntry
+  {
+    long offset;
+    std::vector<KeyframeEntry> keyframes;
+  };
+  std::vector<GameEntry> index_;
+};
+
+// Reads replays back, a game at a time, without ever holding more than
+// a block of the file in memory.
+class ReplayReader
+{
+public:
+  struct Header
+  {
+    int width;
+    int height;
+    Game::Randomizer randomizer;
+    uint64_t seed;
+  };
+
+  // A single input, a keyframe, or the end of the game.  ticks is the
+  // number of ticks that come before it.
+  struct Event
+  {
+    enum Type {
+      INPUT,
+      KEYFRAME,
+      END
+    };
+
+    Type type;
+    Move move;
+    unsigned long ticks;
+    // For the end of a game, its piece and row counts.
+    long pieces;
+    long lines;
+    // For a keyframe, the tick it was taken at and the game as it was.
+    unsigned long tick;
+    GameState state;
+  };
+
+  ReplayReader();
+  ~ReplayReader();
+
+  bool open(const char* path);
+  void close();
+
+  // Read the header of the next game.  Returns false at the end of the
+  // file, or if what follows is not a game.
+  bool nextGame(Header& header);
+
+  // Read the next event of the current game.  Returns false if the
+  // file is cut short or corrupt.
+  bool next(Event& event);
+
+  // Start game the way the current game started; game must have the
+  // dimensions given in the header.
+  void start(const Header& header, Game& game);
+
+  // Play the rest of the current game through game, as fast as the
+  // game can go.  Returns false if the file is corrupt or the game
+  // doesn't finish with the recorded counts.
+  bool play(Game& game);
+
+  // Play the current game through game until it has had the given
+  // number of ticks, or has ended.  play() carries on from there.
+  // Returns false if the file is corrupt.
+  bool playTo(Game& game, unsigned long tick);
+
+  // How many ticks of the current game have been played.
+  unsigned long getTick() const
+  {
+    return tick_;
+  }
+
+  // The number of games in the index, or -1 if the file has none.
+  long getGameCount();
+
+  // Make the given game of the file the current one, and put game
+  // into its state after the given number of ticks, or at its end if
+  // it is shorter than that.  Game is replaced with a game of the
+  // right dimensions if it doesn't have them, so it may be NULL to
+  // start with.  Returns false if the file has no index, or no such
+  // game, or is corrupt.
+  bool seek(long index, unsigned long tick, Game*& game);
+
+  // How many bytes have been read so far.
+  long getBytesRead() const
+  {
+    return offset_ + pos_;
+  }
+
+private:
+  ReplayReader(const ReplayReader&);
+  ReplayReader& operator=(const ReplayReader&);
+
+  // Make sure there is at least one byte to read.
+  bool fill()
+  {
+    return pos_ < size_ || refill();
+  }
+  bool refill();
+  bool get(uint8_t& byte)
+  {
+    if(!fill()) {
+      return false;
+    }
+    byte = buffer_[ pos_++ ];
+    return true;
+  }
+  bool getVarint(uint64_t& value);
+
+  // Carry on reading from the given file offset.
+  bool seekTo(long offset);
+  bool loadIndex();
+
+  FILE* file_;
+  uint8_t* buffer_;
+  int size_;
+  int pos_;
+  // The file offset of the start of the buffer.
+  long offset_;
+
+  // Ticks played of the current game, and an event read but not yet
+  // finished with, when playTo() stopped partway through its ticks.
+  unsigned long tick_;
+  bool pending_;
+  Event event_;
+
+  // The index, once it has been read: where each game starts, and its
+  // keyframes' ticks and offsets.
+  bool indexed_;
+  std::vector<long> games_;
+  std::vector<long> first_keyframe_;
+  std::vector<unsigned long> keyframe_ticks_;
+  std::vector<long> keyframe_offsets_;
+};
+
+#endif // CS488_REPLAY_HPP
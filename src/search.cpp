@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstring>
+
+#include "search.hpp"
+
+// Children are ordered by their parent's position on the level and then
+// their own position among its placements, which is always far less
+// than this.
+static const int MAX_PLACEMENTS = 1 << 10;
+
+const BeamSearch::Options BeamSearch::DEFAULT_OPTIONS = {
+  2,    // depth
+  32,   // width
+  1,    // threads
+  18    // table_bits
+};
+
+BeamSearch::BeamSearch(const Options& options,
+                       const Evaluator::Weights& weights)
+  : options_(options)
+  , evaluator_(weights)
+  , pool_(options.threads)
+  , workers_(options.threads)
+  , table_(NULL)
+  , kept_empty_(false)
+{
+  options_.depth = std::max(0, std::min(options_.depth,
+                                        int(Game::PREVIEW_SIZE)));
+  options_.width = std::max(1, options_.width);
+
+  if(options_.table_bits > 0) {
+    table_ = new TranspositionTable(options_.table_bits);
+  }
+
+  int slots = 1;
+  while(slots < 2 * options_.width) {
+    slots *= 2;
+  }
+  kept_.resize(slots);
+}
+
+BeamSearch::~BeamSearch()
+{
+  delete table_;
+}
+
+void BeamSearch::Worker::clear()
+{
+  boards.clear();
+  lines.clear();
+  first.clear();
+  scores.clear();
+  order.clear();
+}
+
+bool BeamSearch::markKept(uint64_t hash)
+{
+  if(hash == 0) {
+    bool seen = kept_empty_;
+    kept_empty_ = true;
+    return !seen;
+  }
+
+  size_t mask = kept_.size() - 1;
+  for(size_t i = hash & mask; ; i = (i + 1) & mask) {
+    if(kept_[i] == hash) {
+      return false;
+    }
+    if(kept_[i] == 0) {
+      kept_[i] = hash;
+      return true;
+    }
+  }
+}
+
+void BeamSearch::addChildren(Worker& w, const Node& parent,
+                             long parent_index, int piece,
+                             const std::vector<Placement>& placements)
+{
+  const Board& board = parent.board;
+  int start = w.boards.size();
+
+  for(size_t i = 0; i < placements.size(); ++i) {
+    const Placement& pl = placements[i];
+
+    // Locking a piece with its anchor above the well ends the game.
+    if(pl.y >= board.height) {
+      continue;
+    }
+
+    w.boards.push_back(board);
+    int lines = w.boards.back().place(Piece(piece, pl.rotation), pl.x, pl.y);
+    w.lines.push_back(parent.lines + lines);
+    w.first.push_back(parent.first < 0 ? int(i) : parent.first);
+    w.order.push_back(parent_index * MAX_PLACEMENTS + i);
+  }
+
+  int end = w.boards.size();
+  if(end == start) {
+    return;
+  }
+  w.scores.resize(end);
+
+  // Boards are scored without the lines term, which depends on how
+  // they were reached, so that a board's score can be shared by every
+  // path to it.
+  w.missing.clear();
+  w.missing_index.clear();
+  for(int i = start; i < end; ++i) {
+    uint64_t bits;
+    if(table_ && table_->probe(w.boards[i].hash, bits)) {
+      std::memcpy(&w.scores[i], &bits, sizeof(bits));
+    } else {
+      w.missing.push_back(&w.boards[i]);
+      w.missing_index.push_back(i);
+    }
+  }
+
+  int count = w.missing.size();
+  if(count > 0) {
+    w.missing_scores.resize(count);
+    evaluator_.evaluate(&w.missing[0], NULL, count, &w.missing_scores[0]);
+    for(int k = 0; k < count; ++k) {
+      int i = w.missing_index[k];
+      w.scores[i] = w.missing_scores[k];
+      if(table_) {
+        uint64_t bits;
+        std::memcpy(&bits, &w.scores[i], sizeof(bits));
+        table_->store(w.boards[i].hash, bits);
+      }
+    }
+  }
+
+  double weight = evaluator_.getWeights().lines;
+  for(int i = start; i < end; ++i) {
+    w.scores[i] += weight * w.lines[i];
+  }
+}
+
+void BeamSearch::expandLevel(int piece)
+{
+  // Nodes are handed out one at a time from a shared cursor, since
+  // some boards have many more placements than others.
+  cursor_ = 0;
+  int size = beam_.size();
+  pool_.run([this, piece, size](int worker) {
+    Worker& w = workers_[worker];
+    for(;;) {
+      int i = cursor_.fetch_add(1, std::memory_order_relaxed);
+      if(i >= size) {
+        break;
+      }
+      const Board& board = beam_[i].board;
+      Piece p(piece, 0);
+      w.finder.find(board.rows, board.width, board.height, p,
+                    Game::spawnX(board.width), Game::spawnY(board.height, p),
+                    w.placements, PlacementFinder::DROP_ONLY);
+      addChildren(w, beam_[i], i, piece, w.placements);
+    }
+  });
+}
+
+bool BeamSearch::choose(const Game& game, Placement& best)
+{
+  // The first level comes from the falling piece where it actually is,
+  // so that its placements carry the moves that get there.
+  workers_[0].finder.find(game.getRows(), game.getWidth(), game.getHeight(),
+                          game.getPiece(), game.getPieceX(),
+                          game.getPieceY(), roots_,
+                          PlacementFinder::DROP_ONLY);
+  if(roots_.empty()) {
+    return false;
+  }
+
+  Node start;
+  start.board.load(game);
+  start.lines = 0;
+  start.first = -1;
+
+  // The falling piece has to go somewhere, so if every placement ends
+  // the game just take the first.
+  int choice = 0;
+
+  beam_.assign(1, start);
+  for(int level = 0; level <= options_.depth; ++level) {
+    int piece = level == 0 ? game.getPiece().getId()
+                           : game.peekNext(level - 1);
+
+    for(size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].clear();
+    }
+    if(level == 0) {
+      addChildren(workers_[0], start, 0, piece, roots_);
+    } else {
+      expandLevel(piece);
+    }
+
+    candidates_.clear();
+    for(size_t k = 0; k < workers_.size(); ++k) {
+      const Worker& w = workers_[k];
+      for(size_t i = 0; i < w.scores.size(); ++i) {
+        Candidate c = { w.scores[i], w.order[i], int(k), int(i) };
+        candidates_.push_back(c);
+      }
+    }
+    if(candidates_.empty()) {
+      // Every line of play dies here, so go with the best of the
+      // level before.
+      break;
+    }
+
+    // Take the best children in order, skipping any board already
+    // taken.  Usually the first few dozen are enough, so only sort
+    // the rest if it turns out they are needed.
+    size_t count = candidates_.size();
+    size_t sorted = std::min(count, size_t(2 * options_.width));
+    std::partial_sort(candidates_.begin(), candidates_.begin() + sorted,
+                      candidates_.end());
+
+    std::fill(kept_.begin(), kept_.end(), 0);
+    kept_empty_ = false;
+    next_.clear();
+    for(size_t i = 0; i < count && int(next_.size()) < options_.width; ++i) {
+      if(i == sorted) {
+        std::sort(candidates_.begin() + sorted, candidates_.end());
+        sorted = count;
+      }
+
+      const Candidate& c = candidates_[i];
+      const Worker& w = workers_[c.worker];
+      if(!markKept(w.boards[c.index].hash)) {
+        continue;
+      }
+
+      Node node;
+      node.board = w.boards[c.index];
+      node.lines = w.lines[c.index];
+      node.first = w.first[c.index];
+      next_.push_back(node);
+    }
+    beam_.swap(next_);
+    choice = beam_[0].first;
+  }
+
+  best = roots_[ choice ];
+  return true;
+}
@@ -0,0 +1,142 @@
+#ifndef CS488_SEARCH_HPP
+#define CS488_SEARCH_HPP
+
+#include <atomic>
+#include <vector>
+
+#include "ai.hpp"
+#include "game.hpp"
+#include "placement.hpp"
+#include "threadpool.hpp"
+#include "ttable.hpp"
+
+// Looks ahead through the preview queue with a beam search.  The first
+// level holds every placement of the falling piece; each level after
+// that places the next previewed piece on each of the boards kept from
+// the level before.  Only the best few boards of each level are kept,
+// and the falling piece goes wherever the best board on the last level
+// started from.  The boards of a level are expanded in parallel.
+//
+// Different orders of placements often build the same board, so each
+// level keeps only the best of any boards that hash the same, and the
+// scores of boards already seen are looked up in a transposition table
+// shared by all the workers rather than worked out again.  The table
+// lasts from one decision to the next, and most of the boards two
+// levels down from one piece are still around for the next.
+class BeamSearch
+{
+public:
+  struct Options
+  {
+    // How many previewed pieces to look at beyond the falling one, in
+    // [0, Game::PREVIEW_SIZE].  With no lookahead this plays just like
+    // AIPlayer.
+    int depth;
+    // How many boards to keep at each level.
+    int width;
+    // How many threads to expand each level on, counting the caller.
+    int threads;
+    // The transposition table has 2^table_bits entries, or there is no
+    // table if this is 0.
+    int table_bits;
+  };
+
+  static const Options DEFAULT_OPTIONS;
+
+  explicit BeamSearch(const Options& options = DEFAULT_OPTIONS,
+                      const Evaluator::Weights& weights =
+                        Evaluator::DEFAULT_WEIGHTS);
+  ~BeamSearch();
+
+  const Options& getOptions() const
+  {
+    return options_;
+  }
+
+  // Pick the best placement for the falling piece.  Returns false if
+  // the piece has nowhere to go.
+  bool choose(const Game& game, Placement& best);
+
+private:
+  BeamSearch(const BeamSearch&);
+  BeamSearch& operator=(const BeamSearch&);
+
+  // A board kept on the beam, with the rows cleared on the way to it
+  // and the index of the placement of the falling piece it started
+  // from.
+  struct Node
+  {
+    Board board;
+    int lines;
+    int first;
+  };
+
+  // Each worker expands its boards into buffers of its own, a child
+  // per placement, so the workers share nothing but the beam they
+  // read from.
+  struct Worker
+  {
+    PlacementFinder finder;
+    std::vector<Placement> placements;
+    std::vector<Board> boards;
+    std::vector<int> lines;
+    std::vector<int> first;
+    std::vector<double> scores;
+    // The position of each child on the level if the beam had been
+    // expanded in order, to break ties the same way every time.
+    std::vector<long> order;
+    // The children whose scores were not in the table.
+    std::vector<const Board*> missing;
+    std::vector<int> missing_index;
+    std::vector<double> missing_scores;
+
+    void clear();
+  };
+
+  // A child of the current level, by worker and index.
+  struct Candidate
+  {
+    double score;
+    long order;
+    int worker;
+    int index;
+
+    bool operator<(const Candidate& other) const
+    {
+      return score > other.score ||
+             (score == other.score && order < other.order);
+    }
+  };
+
+  // Make a child of parent for each of the given placements of piece,
+  // appending the children and their scores to w's buffers.
+  void addChildren(Worker& w, const Node& parent, long parent_index,
+                   int piece, const std::vector<Placement>& placements);
+
+  // Expand every node of beam_ with the given piece, on every worker.
+  void expandLevel(int piece);
+
+  // Note that a board with the given hash has been kept on this level.
+  // Returns false if one already has been.
+  bool markKept(uint64_t hash);
+
+  Options options_;
+  Evaluator evaluator_;
+  ThreadPool pool_;
+  std::vector<Worker> workers_;
+  TranspositionTable* table_;
+
+  // The hashes of the boards kept on the current level, in an open
+  // addressed set.  Zero marks an empty slot, so the empty board is
+  // tracked on its own.
+  std::vector<uint64_t> kept_;
+  bool kept_empty_;
+
+  std::vector<Placement> roots_;
+  std::vector<Node> beam_;
+  std::vector<Node> next_;
+  std::vector<Candidate> candidates_;
+  std::atomic<int> cursor_;
+};
+
+#endif // CS488_SEARCH_HPP
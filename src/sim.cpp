@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "game.hpp"
+#include "policy.hpp"
+#include "replay.hpp"
+#include "search.hpp"
+#include "workqueue.hpp"
+
+// Games are handed out to the worker threads in batches of this many,
+// so the work queue is only touched once every few thousand pieces.
+static const long BATCH_SIZE = 64;
+
+// Every piece is four cells across lying flat, so narrower wells can't
+// hold one.  Pieces start in the rows above the well, so any height of
+// at least a row will do.
+static const int MIN_WIDTH = 4;
+static const int MIN_HEIGHT = 1;
+
+struct SimConfig
+{
+  long games;
+  const char* policy;
+  int width;
+  int height;
+  long limit;
+  unsigned seed;
+  Game::Randomizer randomizer;
+  BeamSearch::Options search;
+  // Where to record the games, or NULL not to, and how many ticks
+  // apart to write keyframes.
+  const char* record;
+  unsigned long keyframes;
+};
+
+// Totals over a run of games.
+struct SimStats
+{
+  long games;
+  long pieces;
+  long lines;
+  long steals;
+  long bytes;
+};
+
+static void usage(const char* prog)
+{
+  std::fprintf(stderr,
+      "usage: %s [-n games] [-p policy] [-w width] [-h height]\n"
+      "          [-l pieces per game] [-s seed] [-t threads]\n"
+      "          [-r uniform|bag] [-d search depth] [-b beam width]\n"
+      "          [-j search threads per game] [-m log2 table entries]\n"
+      "          [-o record to file] [-k ticks between keyframes]\n"
+      "       %s -i replay file [replay file...]\n"
+      "       %s -i replay file -S game:tick\n"
+      "policies: drop, random, ai, beam\n"
+      "each thread after the first records to the file given with -o\n"
+      "with .N on the end; give -i all of them to check the whole run\n",
+      prog, prog, prog);
+}
+
+static double now()
+{
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Play a single game to the end, or until limit pieces have been
+// placed if limit is non-zero.
+static void playGame(Game& game, Policy& policy, long limit,
+                     ReplayWriter& recorder, SimStats& stats)
+{
+  game.reset();
+  recorder.beginGame(game);
+  ++stats.games;
+
+  for(long n = 0; limit == 0 || n < limit; ++n) {
+    policy.play(game);
+    game.drop();
+
+    // The piece has landed, so this tick locks it in.
+    int rows = game.tick();
+    ++stats.pieces;
+    if(rows < 0) {
+      break;
+    }
+    stats.lines += rows;
+  }
+
+  recorder.endGame(game);
+}
+
+// The file worker records its games to: the path given for the first
+// thread, and that path with the worker's number on the end for the
+// others.
+static std::string recordPath(const char* record, int worker)
+{
+  if(worker == 0) {
+    return record;
+  }
+  char suffix[16];
+  std::snprintf(suffix, sizeof(suffix), ".%d", worker);
+  return std::string(record) + suffix;
+}
+
+// Body of each worker thread.  Game i is always seeded from seed + i,
+// so the totals don't depend on which thread ends up playing it.
+static void runWorker(const SimConfig& config, WorkQueue& queue, int worker,
+                      SimStats& result)
+{
+  Policy* policy = createPolicy(config.policy, config.seed, config.search);
+  Game game(config.width, config.height);
+  SimStats stats = { 0, 0, 0, 0, 0 };
+  ReplayWriter recorder;
+
+  game.setRandomizer(config.randomizer);
+
+  // Each thread records its games to a file of its own.
+  if(config.record != NULL) {
+    std::string path = recordPath(config.record, worker);
+    if(!recorder.open(path.c_str())) {
+      std::fprintf(stderr, "can't write %s\n", path.c_str());
+    }
+    recorder.setKeyframeInterval(config.keyframes);
+    game.setRecorder(&recorder);
+  }
+
+  long batch;
+  while(queue.next(worker, batch)) {
+    long first = batch * BATCH_SIZE;
+    long last = std::min(config.games, first + BATCH_SIZE);
+
+    for(long i = first; i < last; ++i) {
+      game.seed(config.seed + i);
+      policy->seed(config.seed + i);
+      playGame(game, *policy, config.limit, recorder, stats);
+    }
+  }
+
+  stats.steals = queue.getSteals(worker);
+  stats.bytes = recorder.getBytesWritten();
+  if(!recorder.close()) {
+    std::fprintf(stderr, "error writing replays for thread %d\n", worker);
+  }
+  result = stats;
+  delete policy;
+}
+
+// Play config.games games spread over the given number of threads.
+// Returns the elapsed time; per-thread totals are left in results.
+static double runSimulation(const SimConfig& config, int threads,
+                            std::vector<SimStats>& results)
+{
+  long batches = (config.games + BATCH_SIZE - 1) / BATCH_SIZE;
+  WorkQueue queue(batches, threads);
+  std::vector<std::thread> workers;
+
+  results.assign(threads, SimStats());
+
+  double start = now();
+  for(int w = 0; w < threads; ++w) {
+    workers.push_back(std::thread(runWorker, std::cref(config),
+                                  std::ref(queue), w, std::ref(results[w])));
+  }
+  for(int w = 0; w < threads; ++w) {
+    workers[w].join();
+  }
+  return now() - start;
+}
+
+static SimStats total(const std::vector<SimStats>& results)
+{
+  SimStats sum = { 0, 0, 0, 0, 0 };
+  for(size_t i = 0; i < results.size(); ++i) {
+    sum.games += results[i].games;
+    sum.pieces += results[i].pieces;
+    sum.lines += results[i].lines;
+    sum.steals += results[i].steals;
+    sum.bytes += results[i].bytes;
+  }
+  return sum;
+}
+
+// Play back every game in the given replay files, such as the ones
+// each thread of a recorded run wrote, checking each one finishes as
+// recorded.
+static int replay(const std::vector<const char*>& paths)
+{
+  Game* game = NULL;
+  ReplayReader::Header header;
+  long games = 0;
+  long pieces = 0;
+  long lines = 0;
+  long mismatches = 0;
+  long bytes = 0;
+
+  double start = now();
+  for(size_t i = 0; i < paths.size(); ++i) {
+    ReplayReader reader;
+    if(!reader.open(paths[i])) {
+      std::fprintf(stderr, "can't read %s\n", paths[i]);
+      delete game;
+      return 1;
+    }
+
+    while(reader.nextGame(header)) {
+      if(game == NULL || game->getWidth() != header.width ||
+         game->getHeight() != header.height) {
+        delete game;
+        game = new Game(header.width, header.height);
+      }
+
+      reader.start(header, *game);
+      if(!reader.play(*game)) {
+        ++mismatches;
+      }
+      ++games;
+      pieces += game->getPieceCount();
+      lines += game->getLineCount();
+    }
+    bytes += reader.getBytesRead();
+  }
+  double elapsed = now() - start;
+  delete game;
+
+  std::printf("replayed %ld games, %ld pieces, %ld lines from %ld bytes "
+              "in %zu files in %.3f s\n", games, pieces, lines, bytes,
+              paths.size(), elapsed);
+  std::printf("%12.1f bytes/piece\n%12.1f pieces/sec\n%12.1f MB/sec\n",
+              pieces ? double(bytes) / pieces : 0.0, pieces / elapsed,
+              bytes / elapsed / 1e6);
+  if(mismatches > 0) {
+    std::printf("%ld games did not replay as recorded\n", mismatches);
+    return 1;
+  }
+  return 0;
+}
+
+// Seek to a tick of one game in a replay file, and check the game
+// comes out the same as playing it from the start.
+static int seekReplay(const char* path, long index, unsigned long tick)
+{
+  ReplayReader reader;
+  if(!reader.open(path)) {
+    std::fprintf(stderr, "can't read %s\n", path);
+    return 1;
+  }
+
+  Game* game = NULL;
+  double start = now();
+  bool ok = reader.seek(index, tick, game);
+  double seek_elapsed = now() - start;
+  if(!ok) {
+    std::fprintf(stderr, "can't seek to game %ld tick %lu of %s\n", index,
+                 tick, path);
+    delete game;
+    return 1;
+  }
+
+  std::printf("game %ld of %ld, tick %lu: %ld pieces, %ld lines, "
+              "hash %016llx\n", index, reader.getGameCount(),
+              reader.getTick(), game->getPieceCount(), game->getLineCount(),
+              (unsigned long long)game->getHash());
+  std::printf("seek: %.3f ms\n", seek_elapsed * 1e3);
+
+  ReplayReader linear;
+  ReplayReader::Header header;
+  linear.open(path);
+  for(long i = 0; i <= index; ++i) {
+    linear.nextGame(header);
+    if(i < index) {
+      Game skip(header.width, header.height);
+      linear.start(header, skip);
+      linear.play(skip);
+    }
+  }
+  Game expected(header.width, header.height);
+  start = now();
+  linear.start(header, expected);
+  linear.playTo(expected, tick);
+  double linear_elapsed = now() - start;
+  std::printf("play from the start: %.3f ms\n", linear_elapsed * 1e3);
+
+  bool same = expected.getHash() == game->getHash() &&
+              expected.getPieceCount() == game->getPieceCount() &&
+              expected.getLineCount() == game->getLineCount();
+  delete game;
+  if(!same) {
+    std::printf("seeking and playing from the start disagree\n");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv)
+{
+  SimConfig config = { 1000, "random", 10, 20, 100000, 1, Game::UNIFORM,
+                       BeamSearch::DEFAULT_OPTIONS, NULL,
+                       Replay::KEYFRAME_INTERVAL };
+  const char* replay_path = NULL;
+  const char* seek = NULL;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:p:w:h:l:s:t:r:d:b:j:m:o:k:i:S:")) != -1) {
+    switch(opt) {
+    case 'n': config.games = std::atol(optarg); break;
+    case 'p': config.policy = optarg; break;
+    case 'w': config.width = std::atoi(optarg); break;
+    case 'h': config.height = std::atoi(optarg); break;
+    case 'l': config.limit = std::atol(optarg); break;
+    case 's': config.seed = std::strtoul(optarg, NULL, 0); break;
+    case 't': threads = std::atoi(optarg); break;
+    case 'd': config.search.depth = std::atoi(optarg); break;
+    case 'b': config.search.width = std::atoi(optarg); break;
+    case 'j': config.search.threads = std::atoi(optarg); break;
+    case 'm': config.search.table_bits = std::atoi(optarg); break;
+    case 'o': config.record = optarg; break;
+    case 'k': config.keyframes = std::strtoul(optarg, NULL, 0); break;
+    case 'i': replay_path = optarg; break;
+    case 'S': seek = optarg; break;
+    case 'r':
+      if(std::strcmp(optarg, "uniform") == 0) {
+        config.randomizer = Game::UNIFORM;
+      } else if(std::strcmp(optarg, "bag") == 0) {
+        config.randomizer = Game::BAG;
+      } else {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // Any arguments left over are more files to replay.
+  std::vector<const char*> replay_paths;
+  if(replay_path != NULL) {
+    replay_paths.push_back(replay_path);
+    replay_paths.insert(replay_paths.end(), argv + optind, argv + argc);
+  } else if(optind < argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if(replay_path != NULL && seek != NULL) {
+    if(replay_paths.size() > 1) {
+      usage(argv[0]);
+      return 1;
+    }
+    long index;
+    unsigned long tick;
+    if(std::sscanf(seek, "%ld:%lu", &index, &tick) != 2) {
+      usage(argv[0]);
+      return 1;
+    }
+    return seekReplay(replay_path, index, tick);
+  }
+  if(replay_path != NULL) {
+    return replay(replay_paths);
+  }
+
+  if(config.games <= 0 || config.width < MIN_WIDTH ||
+     config.height < MIN_HEIGHT || config.limit < 0 || threads <= 0 ||
+     config.search.depth < 0 || config.search.depth > Game::PREVIEW_SIZE ||
+     config.search.width <= 0 || config.search.threads <= 0 ||
+     config.search.table_bits < 0 || config.search.table_bits > 32) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Policy* policy = createPolicy(config.policy, config.seed, config.search);
+  if(policy == NULL) {
+    std::fprintf(stderr, "%s: unknown policy '%s'\n", argv[0],
+                 config.policy);
+    usage(argv[0]);
+    return 1;
+  }
+
+  // The AI works on Boards, which only hold the narrower wells.
+  if((std::strcmp(policy->getName(), "ai") == 0 ||
+      std::strcmp(policy->getName(), "beam") == 0) &&
+     (config.width > 30 || config.height + 4 > Board::MAX_ROWS)) {
+    std::fprintf(stderr, "%s: the %s policy needs a well at most 30 wide "
+                 "and %d high\n", argv[0], policy->getName(),
+                 Board::MAX_ROWS - 4);
+    delete policy;
+    return 1;
+  }
+
+  std::vector<SimStats> results;
+  double elapsed = runSimulation(config, threads, results);
+  SimStats stats = total(results);
+
+  std::printf("%s policy, %dx%d well, %d threads: %ld games, %ld pieces, "
+              "%ld lines in %.3f s\n", policy->getName(), config.width,
+              config.height, threads, stats.games, stats.pieces,
+              stats.lines, elapsed);
+  if(std::strcmp(policy->getName(), "beam") == 0) {
+    std::printf("beam search: depth %d, width %d, %d threads per game, "
+                "2^%d table entries\n", config.search.depth,
+                config.search.width, config.search.threads,
+                config.search.table_bits);
+  }
+  std::printf("%12.1f games/sec\n%12.1f pieces/sec\n%12.1f lines/sec\n",
+              stats.games / elapsed, stats.pieces / elapsed,
+              stats.lines / elapsed);
+  if(config.record != NULL) {
+    std::printf("recorded %ld bytes, %.2f bytes/piece, to", stats.bytes,
+                double(stats.bytes) / stats.pieces);
+    for(int w = 0; w < threads; ++w) {
+      std::printf(" %s", recordPath(config.record, w).c_str());
+    }
+    std::printf("\n");
+  }
+
+  if(threads > 1) {
+    for(int w = 0; w < threads; ++w) {
+      std::printf("  thread %2d: %8ld games, %4ld steals\n", w,
+                  results[w].games, results[w].steals);
+    }
+
+    // Scaling efficiency is measured against a single thread playing
+    // a slice of the same games.
+    SimConfig single = config;
+    single.games = std::max(BATCH_SIZE, config.games / threads);
+    single.record = NULL;
+    std::vector<SimStats> base_results;
+    double base_elapsed = runSimulation(single, 1, base_results);
+    SimStats base = total(base_results);
+
+    double base_rate = base.pieces / base_elapsed;
+    double rate = stats.pieces / elapsed;
+    std::printf("scaling: %.2fx over 1 thread, %.1f%% efficiency\n",
+                rate / base_rate, 100.0 * rate / (base_rate * threads));
+  }
+
+  delete policy;
+  return 0;
+}
@@ -0,0 +1,85 @@
+#include <cassert>
+
+#include "threadpool.hpp"
+
+ThreadPool::ThreadPool(int workers)
+  : workers_(workers)
+  , task_(NULL)
+  , generation_(0)
+  , running_(0)
+  , stopping_(false)
+{
+  assert(workers_ > 0);
+
+  for(int w = 1; w < workers_; ++w) {
+    threads_.push_back(std::thread(&ThreadPool::loop, this, w));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  start_.notify_all();
+
+  for(size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+}
+
+void ThreadPool::run(const std::function<void(int)>& task)
+{
+  if(workers_ == 1) {
+    task(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    running_ = workers_ - 1;
+    ++generation_;
+  }
+  start_.notify_all();
+
+  task(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(running_ > 0) {
+    done_.wait(lock);
+  }
+  task_ = NULL;
+}
+
+void ThreadPool::loop(int worker)
+{
+  unsigned long seen = 0;
+
+  for(;;) {
+    const std::function<void(int)>* task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while(!stopping_ && generation_ == seen) {
+        start_.wait(lock);
+      }
+      if(stopping_) {
+        return;
+      }
+      seen = generation_;
+      task = task_;
+    }
+
+    (*task)(worker);
+
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      last = --running_ == 0;
+    }
+    if(last) {
+      done_.notify_one();
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef CS488_THREADPOOL_HPP
+#define CS488_THREADPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run one task at a time, all together.
+// The threads are started once and park on a condition variable
+// between tasks, so handing out a task costs a wakeup rather than a
+// thread creation.  The calling thread joins in as worker 0.
+class ThreadPool
+{
+public:
+  // A pool of the given number of workers, counting the caller.
+  explicit ThreadPool(int workers);
+  ~ThreadPool();
+
+  int getWorkers() const
+  {
+    return workers_;
+  }
+
+  // Call task(w) once for every worker w in [0, getWorkers()), each on
+  // its own thread, and return once they have all finished.
+  void run(const std::function<void(int)>& task);
+
+private:
+  ThreadPool(const ThreadPool&);
+  ThreadPool& operator=(const ThreadPool&);
+
+  void loop(int worker);
+
+  int workers_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::function<void(int)>* task_;
+  // Bumped for every task, so a parked thread can tell a new task from
+  // a spurious wakeup.
+  unsigned long generation_;
+  int running_;
+  bool stopping_;
+};
+
+#endif // CS488_THREADPOOL_HPP
@@ -0,0 +1,31 @@
+#include <cassert>
+
+#include "ttable.hpp"
+
+// The number of entries in a table of the given size, checked before
+// anything is shifted by it or allocated.
+static uint64_t tableSize(int bits)
+{
+  assert(bits >= 0 && bits < 40);
+  return uint64_t(1) << bits;
+}
+
+TranspositionTable::TranspositionTable(int bits)
+  : mask_(tableSize(bits) - 1)
+  , entries_(new Entry[ mask_ + 1 ])
+{
+  clear();
+}
+
+TranspositionTable::~TranspositionTable()
+{
+  delete [] entries_;
+}
+
+void TranspositionTable::clear()
+{
+  for(uint64_t i = 0; i <= mask_; ++i) {
+    entries_[i].check.store(0, std::memory_order_relaxed);
+    entries_[i].data.store(0, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef CS488_TTABLE_HPP
+#define CS488_TTABLE_HPP
+
+#include <atomic>
+#include <stdint.h>
+
+// A fixed-size table from 64-bit hashes to 64-bit values that any
+// number of threads can read and write without locking.  Each entry
+// holds the value and the key XORed with the value, in two separate
+// words.  A reader only accepts an entry when the two words agree with
+// the key it looked up, so an entry torn by a concurrent write looks
+// like a miss rather than a wrong answer.  Every store simply replaces
+// whatever was in its slot.  Empty entries look like key zero, so that
+// key is never stored or found.
+class TranspositionTable
+{
+public:
+  // A table of 2^bits entries.
+  explicit TranspositionTable(int bits);
+  ~TranspositionTable();
+
+  // Look up key, leaving its value in data.  Returns whether it was
+  // found.
+  bool probe(uint64_t key, uint64_t& data) const
+  {
+    const Entry& e = entries_[ key & mask_ ];
+    uint64_t d = e.data.load(std::memory_order_relaxed);
+    uint64_t check = e.check.load(std::memory_order_relaxed);
+    if((check ^ d) != key || key == 0) {
+      return false;
+    }
+    data = d;
+    return true;
+  }
+
+  void store(uint64_t key, uint64_t data)
+  {
+    if(key == 0) {
+      return;
+    }
+    Entry& e = entries_[ key & mask_ ];
+    e.check.store(key ^ data, std::memory_order_relaxed);
+    e.data.store(data, std::memory_order_relaxed);
+  }
+
+  // Forget every entry.
+  void clear();
+
+private:
+  TranspositionTable(const TranspositionTable&);
+  TranspositionTable& operator=(const TranspositionTable&);
+
+  struct Entry
+  {
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+  };
+
+  uint64_t mask_;
+  Entry* entries_;
+};
+
+#endif // CS488_TTABLE_HPP
@@ -6,6 +6,18 @@
 
 #include <iostream>
 
+namespace {
+	// How fast persistent rotation turns, in degrees a second: half a
+	// degree every 3ms
+	const double SPIN_SPEED = 0.5 / 0.003;
+
+	// The seconds from one time to a later one
+	double seconds_between( const timeval& from, const timeval& to )
+	{
+		return ( to.tv_sec - from.tv_sec ) +
+			( to.tv_usec - from.tv_usec ) / 1000000.0;
+	}
+}
 
 Viewer::Viewer()
 {
@@ -62,19 +74,34 @@ Viewer::Viewer()
 
 	m_rowCount   = 0;
 
-	m_x1         = 0.0;
-	m_y1         = 0.0;
-	m_z1         = 0.0;
+	build_palette();
+
+	m_wellMode   = m_drawmode;
+	m_wellWidth  = 0;
+	m_wellHeight = 0;
+	m_boardMode  = m_drawmode;
 
 	m_tick       = 500;
 
+	set_frame_rate( FRAME_RATE );
+	m_frameTime.tv_sec  = 0;
+	m_frameTime.tv_usec = 0;
+
 	m_persist    = false;
+
+	m_autoplay   = false;
+	m_aiPiece    = 0;
 }
 
 Viewer::~Viewer()
 {
 	m_gameTiming.disconnect();
-	free(m_game);
+	m_frameTiming.disconnect();
+	if ( m_game )
+	{
+		m_recorder.endGame( *m_game );
+	}
+	delete m_game;
 }
 
 void Viewer::set_drawmode( DrawMode drawmode )
@@ -99,16 +126,52 @@ void Viewer::set_window( AppWindow* window )
 	m_window = window;
 }
 
+void Viewer::set_frame_rate( int fps )
+{
+	m_frameInterval = fps > 0 ? 1000 / fps : 0;
+}
+
+bool Viewer::set_record_file( const char* path )
+{
+	return m_recorder.open( path );
+}
+
 Game* Viewer::get_game()
 {
 	return m_game;
 }
 
 void Viewer::invalidate()
+{
+	// A frame is already on its way, and will show this change too
+	if ( m_frameTiming.connected() )
+	{
+		return;
+	}
+
+	// Otherwise draw one as soon as a frame interval has passed since
+	// the last
+	timeval now;
+	gettimeofday( &now, NULL );
+	double since = seconds_between( m_frameTime, now ) * 1000.0;
+	int    wait  = 0;
+	if ( since >= 0.0 && since < m_frameInterval )
+	{
+		wait = m_frameInterval - static_cast<int>( since );
+	}
+	m_frameTiming = Glib::signal_timeout().connect(
+			sigc::mem_fun(*this, &Viewer::draw_frame), wait );
+}
+
+bool Viewer::draw_frame()
 {
 	//Force a re-render
-	Gtk::Allocation allocation = get_allocation();
-	get_window()->invalidate_rect( allocation, false);
+	if ( is_realized() )
+	{
+		Gtk::Allocation allocation = get_allocation();
+		get_window()->invalidate_rect( allocation, false);
+	}
+	return false;
 }
 
 void Viewer::on_realize()
@@ -149,6 +212,8 @@ bool Viewer::on_expose_event( GdkEventExpose* /*event*/ )
 	{
 		return false;
 	}
+	gettimeofday( &m_frameTime, NULL );
+
 	// Clear the screen
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
@@ -231,20 +296,24 @@ bool Viewer::on_expose_event( GdkEventExpose* /*event*/ )
 	}
 	if ( m_persist )
 	{
+		// Turn by however long it has been since the last frame, so
+		// the speed doesn't depend on the frame rate
+		double step = SPIN_SPEED * seconds_between( m_spinTime, m_frameTime );
+		m_spinTime  = m_frameTime;
 		if ( m_button1 )
 		{
-			m_rotx = ( m_rotx + (0.5 * m_xdir) ) - static_cast<double>(
-					static_cast<int>(( m_rotx + (0.5 * m_xdir) ) / 360) ) * 360;
+			m_rotx = ( m_rotx + (step * m_xdir) ) - static_cast<double>(
+					static_cast<int>(( m_rotx + (step * m_xdir) ) / 360) ) * 360;
 		}
 		if ( m_button2 )
 		{
-			m_roty = ( m_roty + (0.5 * m_ydir) ) - static_cast<double>(
-					static_cast<int>(( m_roty + (0.5 * m_ydir) ) / 360) ) * 360;
+			m_roty = ( m_roty + (step * m_ydir) ) - static_cast<double>(
+					static_cast<int>(( m_roty + (step * m_ydir) ) / 360) ) * 360;
 		}
 		if ( m_button3 )
 		{
-			m_rotz = ( m_rotz + (0.5 * m_zdir) ) - static_cast<double>(
-					static_cast<int>(( m_rotz + (0.5 * m_zdir) ) / 360) ) * 360;
+			m_rotz = ( m_rotz + (step * m_zdir) ) - static_cast<double>(
+					static_cast<int>(( m_rotz + (step * m_zdir) ) / 360) ) * 360;
 		}
 		glRotated( m_rotx, 1.0, 0.0, 0.0 );
 		glRotated( m_roty, 0.0, 1.0, 0.0 );
@@ -258,11 +327,13 @@ bool Viewer::on_expose_event( GdkEventExpose* /*event*/ )
 		glRotated( m_rotz, 0.0, 0.0, 1.0 );
 	}
 
-	// You'll be drawing unit cubes, so the game will have width
-	// 10 and height 24 (game = 20, stripe = 4).  Let's translate
-	// the game so that we can draw it starting at (0,0) but have
-	// it appear centred in the window.
-	glTranslated( -5.0, -12.0, 0.0 );
+	// You'll be drawing unit cubes, so the game is as wide as the
+	// well and four rows taller (the stripe a new piece falls in
+	// from).  Let's translate the game so that we can draw it starting
+	// at (0,0) but have it appear centred in the window.
+	int width  = m_game ? m_game->getWidth()  : WELL_WIDTH;
+	int height = m_game ? m_game->getHeight() : WELL_HEIGHT;
+	glTranslated( -width / 2.0, -( height + 4 ) / 2.0, 0.0 );
 
 	// Set up the draw mode
 	if ( m_drawmode == Viewer::WIRE_FRAME )
@@ -294,6 +365,12 @@ bool Viewer::on_expose_event( GdkEventExpose* /*event*/ )
 
 	gldrawable->gl_end();
 
+	// Keep spinning
+	if ( m_persist )
+	{
+		invalidate();
+	}
+
 	return true;
 }
 
@@ -352,7 +429,6 @@ bool Viewer::on_button_press_event( GdkEventButton* event )
 	m_ixpos   = event->x;
 	m_xpos    = event->x;
 	m_persist = false;
-	m_rotateTiming.disconnect();
 	invalidate();
 	return true;
 }
@@ -363,13 +439,12 @@ bool Viewer::on_button_release_event( GdkEventButton* /*event*/ )
 	if ( !m_key && abs(m_curtime.tv_usec - m_lasttime.tv_usec) < 10000 )
 	{
 		m_persist = true;
-		m_rotateTiming = Glib::signal_timeout().connect(
-				sigc::mem_fun(*this, &Viewer::inval_sig), 3 );
+		m_spinTime = m_curtime;
+		invalidate();
 	}
 	else
 	{
 		m_persist = false;
-		m_rotateTiming.disconnect();
 		m_button1 = false;
 		m_button2 = false;
 		m_button3 = false;
@@ -386,195 +461,306 @@ bool Viewer::on_motion_notify_event(GdkEventMotion* event)
 	{
 		m_xpos   = event->x;
 		gettimeofday( &m_lasttime, NULL );
+		invalidate();
 	}
-	invalidate();
 	return true;
 }
 
-void Viewer::drawCube( double x, double y, double z, int type )
+void Viewer::set_Colour( int type, double rgb[3] )
 {
-	glBegin(GL_QUADS);
-
 	// Set which type of game piece we have
 	switch (type)
 	{
 	case 0:
-		m_x1 = 0.0;
-		m_y1 = 1.0;
-		m_z1 = 0.0;
+		rgb[0] = 0.0;
+		rgb[1] = 1.0;
+		rgb[2] = 0.0;
 		break;
 	case 1:
-		m_x1 = 1.0;
-		m_y1 = 0.5;
-		m_z1 = 0.0;
+		rgb[0] = 1.0;
+		rgb[1] = 0.5;
+		rgb[2] = 0.0;
 		break;
 	case 2:
-		m_x1 = 1.0;
-		m_y1 = 0.0;
-		m_z1 = 0.0;
+		rgb[0] = 1.0;
+		rgb[1] = 0.0;
+		rgb[2] = 0.0;
 		break;
 	case 3:
-		m_x1 = 1.0;
-		m_y1 = 1.0;
-		m_z1 = 0.0;
+		rgb[0] = 1.0;
+		rgb[1] = 1.0;
+		rgb[2] = 0.0;
 		break;
 	case 4:
-		m_x1 = 0.0;
-		m_y1 = 0.0;
-		m_z1 = 1.0;
+		rgb[0] = 0.0;
+		rgb[1] = 0.0;
+		rgb[2] = 1.0;
 		break;
 	case 5:
-		m_x1 = 1.0;
-		m_y1 = 0.0;
-		m_z1 = 1.0;
+		rgb[0] = 1.0;
+		rgb[1] = 0.0;
+		rgb[2] = 1.0;
 		break;
 	case 6:
-		m_x1 = 1.0;
-		m_y1 = 1.0;
-		m_z1 = 1.0;
+		rgb[0] = 1.0;
+		rgb[1] = 1.0;
+		rgb[2] = 1.0;
 		break;
 	default:
-		m_x1 = 0.0;
-		m_y1 = 0.0;
-		m_z1 = 0.0;
+		rgb[0] = 0.0;
+		rgb[1] = 0.0;
+		rgb[2] = 0.0;
 		break;
 	}
-	glColor3d( m_x1, m_y1, m_z1 );
+}
 
-	// Draw the front
-	if ( m_drawmode == MULTICOLOURED )
+void Viewer::set_Multi( double rgb[3] )
+{
+	// Calculate the next colour based on the previous colour
+	// Basic idea is a base 3 number system
+	if (rgb[0] < 1.0)
 	{
-		set_Multi();
+		rgb[0] += 0.5;
 	}
-	glVertex3d( x+1.0, y+1.0, z     ); // Front
-	glVertex3d( x,     y+1.0, z     );
-	glVertex3d( x,     y,     z     );
-	glVertex3d( x+1.0, y,     z     );
-
-	// Draw the back
-	if ( m_drawmode == MULTICOLOURED )
+	else
 	{
-		set_Multi();
+		if (rgb[1] < 1.0)
+		{
+			rgb[1] += 0.5;
+		}
+		else
+		{
+			if (rgb[2] < 1.0)
+			{
+				rgb[2] += 0.5;
+			}
+			else
+			{
+				rgb[0] = 0;
+				rgb[1] = 0;
+				rgb[2] = 0;
+			}
+		}
 	}
-	glVertex3d( x,     y+1.0, z-1.0 ); // Back
-	glVertex3d( x+1.0, y+1.0, z-1.0 );
-	glVertex3d( x+1.0, y,     z-1.0 );
-	glVertex3d( x,     y,     z-1.0 );
+}
 
-	// Draw the top
-	if ( m_drawmode == MULTICOLOURED )
-	{
-		set_Multi();
-	}
-	// Make sides of wells grey if not in multicoloured mode
-	else if ( type == -1 )
+void Viewer::build_palette()
+{
+	for ( int multi = 0; multi < 2; multi++ )
 	{
-		m_x1 = 0.2;
-		m_y1 = 0.2;
-		m_z1 = 0.2;
-		glColor3d( m_x1, m_y1, m_z1 );
-	}
-	glVertex3d( x+1.0, y+1.0, z-1.0 ); // Top
-	glVertex3d( x,     y+1.0, z-1.0 );
-	glVertex3d( x,     y+1.0, z     );
-	glVertex3d( x+1.0, y+1.0, z     );
+		for ( int type = -1; type < NUM_PIECES; type++ )
+		{
+			double rgb[3];
+			set_Colour( type, rgb );
 
-	// Draw the bottom
-	if ( m_drawmode == MULTICOLOURED )
-	{
-		set_Multi();
+			// Each side of a cube is drawn in turn, and in the
+			// multicoloured mode each one steps the colour on
+			for ( int side = 0; side < BoardMesher::NUM_SIDES; side++ )
+			{
+				if ( multi )
+				{
+					set_Multi( rgb );
+				}
+				// Make sides of wells grey if not in multicoloured
+				// mode
+				else if ( type == -1 && side == BoardMesher::TOP )
+				{
+					rgb[0] = 0.2;
+					rgb[1] = 0.2;
+					rgb[2] = 0.2;
+				}
+
+				Colour& colour = m_palette[multi][type + 1][side];
+				colour.r = (unsigned char)( rgb[0] * 255.0 + 0.5 );
+				colour.g = (unsigned char)( rgb[1] * 255.0 + 0.5 );
+				colour.b = (unsigned char)( rgb[2] * 255.0 + 0.5 );
+				colour.a = 255;
+			}
+		}
 	}
-	glVertex3d( x+1.0, y,     z     ); // Bottom
-	glVertex3d( x,     y,     z     );
-	glVertex3d( x,     y,     z-1.0 );
-	glVertex3d( x+1.0, y,     z-1.0 );
+}
 
-	// Draw the left
-	if ( m_drawmode == MULTICOLOURED )
+const Viewer::Colour* Viewer::get_palette( int type ) const
+{
+	return m_palette[ m_drawmode == MULTICOLOURED ][ type + 1 ];
+}
+
+void Viewer::drawCube( int x, int y, int type )
+{
+	const Colour* colours = get_palette( type );
+	for ( int side = 0; side < BoardMesher::NUM_SIDES; side++ )
 	{
-		set_Multi();
+		drawFace( x, y, 1, side, colours[side] );
 	}
-	glVertex3d( x, y+1.0, z         ); // Left
-	glVertex3d( x, y+1.0, z-1.0     );
-	glVertex3d( x, y,     z-1.0     );
-	glVertex3d( x, y,     z         );
+}
 
-	// Draw the right
-	if ( m_drawmode == MULTICOLOURED )
-	{
-		set_Multi();
+void Viewer::drawFace( int x, int y, int w, int side, Colour colour )
+{
+	// Cubes sit between z = -1 and z = 0
+	switch ( side )
+	{
+	case BoardMesher::FRONT:
+		addVertex( x+w, y+1,  0, colour );
+		addVertex( x,   y+1,  0, colour );
+		addVertex( x,   y,    0, colour );
+		addVertex( x+w, y,    0, colour );
+		break;
+	case BoardMesher::BACK:
+		addVertex( x,   y+1, -1, colour );
+		addVertex( x+w, y+1, -1, colour );
+		addVertex( x+w, y,   -1, colour );
+		addVertex( x,   y,   -1, colour );
+		break;
+	case BoardMesher::TOP:
+		addVertex( x+w, y+1, -1, colour );
+		addVertex( x,   y+1, -1, colour );
+		addVertex( x,   y+1,  0, colour );
+		addVertex( x+w, y+1,  0, colour );
+		break;
+	case BoardMesher::BOTTOM:
+		addVertex( x+w, y,    0, colour );
+		addVertex( x,   y,    0, colour );
+		addVertex( x,   y,   -1, colour );
+		addVertex( x+w, y,   -1, colour );
+		break;
+	case BoardMesher::LEFT:
+		addVertex( x,   y+1,  0, colour );
+		addVertex( x,   y+1, -1, colour );
+		addVertex( x,   y,   -1, colour );
+		addVertex( x,   y,    0, colour );
+		break;
+	case BoardMesher::RIGHT:
+		addVertex( x+w, y+1, -1, colour );
+		addVertex( x+w, y+1,  0, colour );
+		addVertex( x+w, y,    0, colour );
+		addVertex( x+w, y,   -1, colour );
+		break;
 	}
-	glVertex3d( x+1.0, y+1.0, z-1.0 ); // Right
-	glVertex3d( x+1.0, y+1.0, z     );
-	glVertex3d( x+1.0, y,     z     );
-	glVertex3d( x+1.0, y,     z-1.0 );
+}
 
-	glEnd();
+void Viewer::addVertex( int x, int y, int z, Colour colour )
+{
+	Vertex v = { colour, (short)x, (short)y, (short)z, 0 };
+	m_vertices.push_back( v );
 }
 
-void Viewer::set_Multi()
+void Viewer::drawGame()
 {
-	// Calculate the next colour based on the previous colour
-	// Basic idea is a base 3 number system
-	if (m_x1 < 1.0)
+	int width  = m_game ? m_game->getWidth()  : WELL_WIDTH;
+	int height = m_game ? m_game->getHeight() : WELL_HEIGHT;
+
+	if ( m_drawmode != m_wellMode || width  != m_wellWidth ||
+	     height     != m_wellHeight )
 	{
-		m_x1 += 0.5;
+		m_vertices.clear();
+		drawWell( width, height );
+		m_well.swap( m_vertices );
+		m_wellMode   = m_drawmode;
+		m_wellWidth  = width;
+		m_wellHeight = height;
 	}
-	else
+	drawVertices( m_well );
+
+	if ( m_game == NULL )
 	{
-		if (m_y1 < 1.0)
-		{
-			m_y1 += 0.5;
-		}
-		else
+		return;
+	}
+
+	if ( m_drawmode == WIRE_FRAME )
+	{
+		// Every cube is drawn whole, so that all of its edges show
+		m_vertices.clear();
+		for ( int i = 0; i < height + 4; i++ )
 		{
-			if (m_z1 < 1.0)
+			for ( int j = 0; j < width; j++ )
 			{
-				m_z1 += 0.5;
+				int piece = m_game->get( i, j );
+				if ( piece >= 0 )
+				{
+					drawCube( j, i, piece );
+				}
 			}
-			else
+		}
+		drawVertices( m_vertices );
+		return;
+	}
+
+	// Otherwise only the faces of the locked cells that can be seen
+	// are drawn.  They only change when a piece locks, so they are
+	// kept from frame to frame, and only the rows that changed are
+	// looked at again
+	if ( m_mesher.update( *m_game ) || m_drawmode != m_boardMode )
+	{
+		m_vertices.clear();
+		drawBoard();
+		m_board.swap( m_vertices );
+		m_boardMode = m_drawmode;
+	}
+	drawVertices( m_board );
+
+	// The falling piece moves every tick, so is drawn afresh
+	m_vertices.clear();
+	const Piece& piece = m_game->getPiece();
+	for ( int r = 0; r < 4; r++ )
+	{
+		for ( int c = 0; c < 4; c++ )
+		{
+			if ( piece.isOn( r, c ) )
 			{
-				m_x1 = 0;
-				m_y1 = 0;
-				m_z1 = 0;
+				drawCube( m_game->getPieceX() + c, m_game->getPieceY() - r,
+				          piece.getColourIndex() );
 			}
 		}
 	}
+	drawVertices( m_vertices );
+}
 
-	// Set the draw colour
-	glColor3d( m_x1, m_y1, m_z1 );
+void Viewer::drawBoard()
+{
+	for ( int r = 0; r < m_mesher.getRowCount(); r++ )
+	{
+		const std::vector<BoardMesher::Face>& faces = m_mesher.getRow( r );
+		for ( size_t i = 0; i < faces.size(); i++ )
+		{
+			const BoardMesher::Face& face = faces[i];
+			drawFace( face.x, r, face.width, face.side,
+			          get_palette( face.colour )[ face.side ] );
+		}
+	}
 }
 
-void Viewer::drawGame()
+void Viewer::drawWell( int width, int height )
 {
-	// Draw well
-	for ( double i = -1.0; i < 20.0; i+=1.0 )
+	// The side walls
+	for ( int i = -1; i < height; i++ )
 	{
-		drawCube( -1.0, i, 0.0, -1 );
-		drawCube( 10.0, i, 0.0, -1 );
+		drawCube( -1, i, -1 );
+		drawCube( width, i, -1 );
 	}
 	// Draws the bottom wall
-	for ( double i = 0.0; i < 10.0; i+=1.0 )
+	for ( int i = 0; i < width; i++ )
 	{
-		drawCube( i, -1.0, 0.0, -1 );
+		drawCube( i, -1, -1 );
 	}
+}
 
-	// Draw pieces
-	int piece;
-	if ( m_game != NULL )
+void Viewer::drawVertices( const std::vector<Vertex>& vertices )
+{
+	if ( vertices.empty() )
 	{
-		for ( int i = 0; i < 24; i++ )
-		{
-			for ( int j = 0; j < 10; j++ )
-			{
-				piece = m_game->get( i, j );
-				if ( piece >= 0 )
-				{
-					drawCube( j, i, 0.0, piece );
-				}
-			}
-		}
+		return;
 	}
+
+	// Hand the whole batch to GL at once, rather than a vertex at a
+	// time.  Vertex arrays, and bytes and shorts in them, are in every
+	// GL since 1.1, so this works on software renderers too
+	glEnableClientState( GL_COLOR_ARRAY );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glColorPointer( 4, GL_UNSIGNED_BYTE, sizeof(Vertex), &vertices[0].colour );
+	glVertexPointer( 3, GL_SHORT, sizeof(Vertex), &vertices[0].x );
+	glDrawArrays( GL_QUADS, 0, vertices.size() );
+	glDisableClientState( GL_COLOR_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
 }
 
 int Viewer::execute_tick()
@@ -583,8 +769,16 @@ int Viewer::execute_tick()
 	{
 		return 1;
 	}
+	if ( m_autoplay )
+	{
+		autoplay();
+	}
 	int rows = m_game->tick();
-	invalidate();
+	if ( rows < 0 )
+	{
+		m_recorder.endGame( *m_game );
+	}
+	game_changed();
 	m_rowCount += rows;
 	if      ( m_rowCount >= 20 )
 	{
@@ -598,6 +792,24 @@ int Viewer::execute_tick()
 	return 1;
 }
 
+void Viewer::autoplay()
+{
+	// Only decide once per piece, so the player can still nudge it
+	if ( m_game->getPieceCount() == m_aiPiece )
+	{
+		return;
+	}
+	m_aiPiece = m_game->getPieceCount();
+
+	if ( m_ai.choose( *m_game, m_placement ) )
+	{
+		for ( size_t i = 0; i < m_placement.path.size(); ++i )
+		{
+			m_game->apply( m_placement.path[i] );
+		}
+	}
+}
+
 void Viewer::update_speed( Speed speed )
 {
 	if ( speed == FAST )
@@ -625,10 +837,15 @@ void Viewer::update_speed( Speed speed )
 	}
 }
 
-int Viewer::inval_sig()
+void Viewer::game_changed()
 {
-	invalidate();
-	return 1;
+	// A tick on a finished game, or a move that was blocked, changes
+	// nothing, so there is nothing new to draw
+	if ( m_game->drainChanges( m_changes ) )
+	{
+		m_mesher.apply( m_changes );
+		invalidate();
+	}
 }
 
 void Viewer::swap_buffermode()
@@ -651,23 +868,30 @@ void Viewer::reset()
 	m_rotx       = 0.0;
 	m_roty       = 0.0;
 	m_rotz       = 0.0;
-
-	m_x1         = 0.0;
-	m_y1         = 0.0;
-	m_z1         = 0.0;
 	invalidate();
 }
 
 void Viewer::newGame()
 {
 	update_speed( SLOW );
-	free(m_game);
-	m_game     = new Game::Game( 10, 20 );
+	if ( m_game )
+	{
+		m_recorder.endGame( *m_game );
+	}
+	delete m_game;
+	m_game     = new Game( WELL_WIDTH, WELL_HEIGHT );
+	// Restart the pieces from the game's seed, so the recording can
+	// start them the same way
+	m_game->seed( m_game->getSeed() );
 	m_game->reset();
+	m_game->setRecorder( &m_recorder );
+	m_game->setChangeLog( true );
+	m_recorder.beginGame( *m_game );
+	m_aiPiece  = 0;
 	m_gameTiming.disconnect();
 	m_gameTiming = Glib::signal_timeout().connect(
 			sigc::mem_fun(*this, &Viewer::execute_tick), m_tick );
-	invalidate();
+	game_changed();
 }
 
 void Viewer::moveLeft()
@@ -675,6 +899,7 @@ void Viewer::moveLeft()
 	if ( m_game )
 	{
 		m_game->moveLeft();
+		game_changed();
 	}
 }
 
@@ -683,6 +908,7 @@ void Viewer::moveRight()
 	if ( m_game )
 	{
 		m_game->moveRight();
+		game_changed();
 	}
 }
 
@@ -691,6 +917,7 @@ void Viewer::rotateCCW()
 	if ( m_game )
 	{
 		m_game->rotateCCW();
+		game_changed();
 	}
 }
 
@@ -699,6 +926,7 @@ void Viewer::rotateCW()
 	if ( m_game )
 	{
 		m_game->rotateCW();
+		game_changed();
 	}
 }
 
@@ -707,5 +935,11 @@ void Viewer::drop()
 	if ( m_game )
 	{
 		m_game->drop();
+		game_changed();
 	}
 }
+
+void Viewer::toggle_autoplay()
+{
+	m_autoplay = !m_autoplay;
+}
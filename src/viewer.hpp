@@ -6,7 +6,10 @@
 
 #include <sys/time.h>
 
+#include "ai.hpp"
 #include "game.hpp"
+#include "mesher.hpp"
+#include "replay.hpp"
 
 class AppWindow;
 
@@ -29,6 +32,14 @@ public:
 		FAST
 	};
 
+	// Dimensions of the well for new games.  Everything else about
+	// the well is drawn from the game itself.
+	static const int WELL_WIDTH  = 10;
+	static const int WELL_HEIGHT = 20;
+
+	// The most frames a second drawn unless told otherwise
+	static const int FRAME_RATE = 60;
+
 	Viewer();
 	virtual ~Viewer();
 
@@ -37,6 +48,11 @@ public:
 	void set_speed   ( Speed      speed    );
 	void set_key     ( int        key      );
 	void set_window  ( AppWindow* window   );
+	// Draw at most fps frames a second, or as often as asked if 0
+	void set_frame_rate( int fps );
+
+	// Record every game from now on to the given file
+	bool set_record_file( const char* path );
 
 	// Getter functions
 	Game* get_game ();
@@ -44,7 +60,9 @@ public:
 	// A useful function that forces this widget to rerender. If you
 	// want to render a new frame, do not call on_expose_event
 	// directly. Instead call this, which will cause an on_expose_event
-	// call when the time is right.
+	// call when the time is right.  However often it is called, frames
+	// are drawn no more often than the frame rate allows, and nothing
+	// is drawn until it is called.
 	void invalidate();
 
 	// Utility functions for updating game state
@@ -59,6 +77,9 @@ public:
 	void rotateCW();
 	void drop();
 
+	// Let the AI play the falling pieces
+	void toggle_autoplay();
+
 protected:
 	// Events we implement
 	// Note that we could use gtkmm's "signals and slots" mechanism
@@ -80,32 +101,84 @@ protected:
 	virtual bool on_motion_notify_event(GdkEventMotion* event);
 
 private:
-	// Used to draw a unit cube
-	void drawCube( double x, double y, double z, int type );
-	// Makes the colours of the unit cube assorted
-	void set_Multi();
+	// A colour as a vertex array holds it: red, green, blue and alpha,
+	// a byte each
+	struct Colour
+	{
+		unsigned char r, g, b, a;
+	};
+	// One corner of a face: its colour, and its position in cells,
+	// which are unit-aligned so need only small integers.  The padding
+	// keeps vertices 4-byte aligned, at 12 bytes each
+	struct Vertex
+	{
+		Colour colour;
+		short  x, y, z;
+		short  pad;
+	};
 
-	// Used to draw the current game state
+	// Adds a unit cube to the frame's vertices
+	void drawCube( int x, int y, int type );
+	// Adds one side of a row of w cubes
+	void drawFace( int x, int y, int w, int side, Colour colour );
+	// Adds a corner
+	void addVertex( int x, int y, int z, Colour colour );
+
+	// Works out the colour of every side of every type of cube, for
+	// each draw mode, once and for all
+	void build_palette();
+	// The colours of the sides of the given type of cube in the
+	// current draw mode, in BoardMesher::Side order; -1 is the well
+	const Colour* get_palette( int type ) const;
+	// Sets rgb to the colour of the given type of piece, or of the
+	// well for -1
+	static void set_Colour( int type, double rgb[3] );
+	// Makes the colours of the unit cube assorted, by stepping rgb on
+	// to the next colour
+	static void set_Multi( double rgb[3] );
+
+	// Used to draw the current game state, as one batch of quads for
+	// the well and one for the pieces
 	void drawGame();
+	// Adds the walls and floor of a well of the given size
+	void drawWell( int width, int height );
+	// Adds the faces the mesher found
+	void drawBoard();
+	// Hands a batch of quads to GL
+	void drawVertices( const std::vector<Vertex>& vertices );
 
 	// Move clock by one tick
 	int  execute_tick();
 
+	// Take whatever the game has logged since last time, pass it to
+	// the mesher, and rerender if anything changed
+	void game_changed();
+
+	// Move a newly spawned piece to where the AI wants it
+	void autoplay();
+
 	// Update the game speed
 	void update_speed( Speed speed );
 
-	// Invalidate function for signals
-	int inval_sig();
+	// Asks for the frame invalidate() scheduled to be drawn
+	bool draw_frame();
 
 	// The AppWindow object
 	AppWindow*       m_window;
 
-	// The game object
+	// The game object, and the changes last taken from its log
 	Game*            m_game;
+	std::vector<Game::Change> m_changes;
 
 	// Timer connection for advancing gameplay
 	sigc::connection m_gameTiming;
 
+	// The frame waiting to be drawn, if any, the milliseconds to leave
+	// between frames, and when the last one was drawn
+	sigc::connection m_frameTiming;
+	int              m_frameInterval;
+	timeval          m_frameTime;
+
 	// Current game state
 	Speed            m_speed;
 	DrawMode         m_drawmode;
@@ -133,10 +206,26 @@ private:
 	// Number of cleared rows, used to decide game speed
 	int              m_rowCount;
 
-	// Used for calculating assorted colours
-	double           m_x1;
-	double           m_y1;
-	double           m_z1;
+	// The quads of the frame being drawn, kept between frames so the
+	// storage is reused
+	std::vector<Vertex> m_vertices;
+
+	// The well never changes, so its quads are only built again when
+	// the draw mode or the size of the well does
+	std::vector<Vertex> m_well;
+	DrawMode         m_wellMode;
+	int              m_wellWidth;
+	int              m_wellHeight;
+
+	// The seen faces of the locked cells, and their quads, built for
+	// m_boardMode
+	BoardMesher      m_mesher;
+	std::vector<Vertex> m_board;
+	DrawMode         m_boardMode;
+
+	// The colour of each side of each type of cube, the well first,
+	// in plain colours and assorted ones
+	Colour           m_palette[2][NUM_PIECES + 1][BoardMesher::NUM_SIDES];
 
 	// Game tick time
 	int              m_tick;
@@ -145,7 +234,17 @@ private:
 	bool             m_persist;
 	timeval          m_lasttime;
 	timeval          m_curtime;
-	sigc::connection m_rotateTiming;
+	// When the persistent rotation was last turned
+	timeval          m_spinTime;
+
+	// Autoplay state: the AI, and the piece it last placed
+	bool             m_autoplay;
+	AIPlayer         m_ai;
+	long             m_aiPiece;
+	Placement        m_placement;
+
+	// Records games, if a file has been given
+	ReplayWriter     m_recorder;
 
 	int test();
 };
@@ -0,0 +1,80 @@
+#ifndef CS488_WELLSIZE_HPP
+#define CS488_WELLSIZE_HPP
+
+// Well dimensions for the code that loops over a whole well.  Such code
+// is written against a Size parameter and compiled once for each of the
+// common well sizes, as a FixedSize whose width, row count and words
+// per row are compile-time constants, and once more for AnySize, which
+// reads them at run time.  With constants, the row strides, loop bounds
+// and full-row masks fold away and the short loops over columns unroll.
+
+template<int W, int H>
+struct FixedSize
+{
+  static const int WIDTH = W;
+  static const int HEIGHT = H;
+
+  int width() const
+  {
+    return W;
+  }
+  int height() const
+  {
+    return H;
+  }
+  // The well plus the four rows above it for a falling piece.
+  int rows() const
+  {
+    return H + 4;
+  }
+  // The 64-bit occupancy words in each row.
+  int words() const
+  {
+    return (W + 63) / 64;
+  }
+};
+
+struct AnySize
+{
+  AnySize(int width, int height)
+    : width_(width)
+    , height_(height)
+  {}
+
+  int width() const
+  {
+    return width_;
+  }
+  int height() const
+  {
+    return height_;
+  }
+  int rows() const
+  {
+    return height_ + 4;
+  }
+  int words() const
+  {
+    return (width_ + 63) / 64;
+  }
+
+private:
+  int width_;
+  int height_;
+};
+
+// Call f with the Size for a well of the given dimensions: a FixedSize
+// if it is one of the common ones, or else an AnySize.
+template<class F>
+inline void withWellSize(int width, int height, F f)
+{
+  if(width == 10 && height == 20) {
+    f(FixedSize<10, 20>());
+  } else if(width == 10 && height == 22) {
+    f(FixedSize<10, 22>());
+  } else {
+    f(AnySize(width, height));
+  }
+}
+
+#endif // CS488_WELLSIZE_HPP
@@ -0,0 +1,69 @@
+#include "workqueue.hpp"
+
+WorkQueue::WorkQueue(long count, int workers)
+  : workers_(workers)
+{
+  slots_ = new Slot[ workers_ ];
+
+  for(int w = 0; w < workers_; ++w) {
+    uint32_t begin = count * w / workers_;
+    uint32_t end = count * (w+1) / workers_;
+    slots_[w].range.store(pack(begin, end), std::memory_order_relaxed);
+    slots_[w].steals = 0;
+  }
+}
+
+WorkQueue::~WorkQueue()
+{
+  delete [] slots_;
+}
+
+bool WorkQueue::next(int worker, long& item)
+{
+  std::atomic<uint64_t>& range = slots_[ worker ].range;
+
+  while(true) {
+    uint64_t r = range.load(std::memory_order_acquire);
+    uint32_t begin = r >> 32;
+    uint32_t end = r;
+
+    if(begin < end) {
+      if(range.compare_exchange_weak(r, pack(begin+1, end),
+                                     std::memory_order_acq_rel)) {
+        item = begin;
+        return true;
+      }
+    } else if(!steal(worker)) {
+      return false;
+    }
+  }
+}
+
+bool WorkQueue::steal(int worker)
+{
+  // Only the owner ever adds work to its own slot, and it only steals
+  // when its slot is empty, so a stolen range can simply be stored.
+  for(int i = 1; i < workers_; ++i) {
+    std::atomic<uint64_t>& victim = slots_[ (worker + i) % workers_ ].range;
+    uint64_t r = victim.load(std::memory_order_acquire);
+
+    while(true) {
+      uint32_t begin = r >> 32;
+      uint32_t end = r;
+      if(begin >= end) {
+        break;
+      }
+
+      uint32_t mid = begin + (end - begin) / 2;
+      if(victim.compare_exchange_weak(r, pack(begin, mid),
+                                      std::memory_order_acq_rel)) {
+        slots_[ worker ].range.store(pack(mid, end),
+                                     std::memory_order_release);
+        ++slots_[ worker ].steals;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,51 @@
+#ifndef CS488_WORKQUEUE_HPP
+#define CS488_WORKQUEUE_HPP
+
+#include <atomic>
+#include <stdint.h>
+
+// Hands out the integers [0, count) to a fixed set of workers with
+// work stealing.  Each worker starts with an equal contiguous share
+// and takes items from the front of it.  A worker that runs dry steals
+// the back half of another worker's remaining share.  A share is a
+// single packed (begin, end) word updated with compare-and-swap, so
+// nothing ever takes a lock, and each share sits on its own cache
+// lines so owners don't contend with each other.
+class WorkQueue
+{
+public:
+  WorkQueue(long count, int workers);
+  ~WorkQueue();
+
+  // Take the next item for the given worker.  Returns false once
+  // every item has been handed out.
+  bool next(int worker, long& item);
+
+  // How many times the given worker has stolen from another.
+  long getSteals(int worker) const
+  {
+    return slots_[ worker ].steals;
+  }
+
+private:
+  bool steal(int worker);
+
+  static uint64_t pack(uint32_t begin, uint32_t end)
+  {
+    return (uint64_t(begin) << 32) | end;
+  }
+
+  struct Slot
+  {
+    std::atomic<uint64_t> range;
+    long steals;
+    // Keep each slot's range two cache lines away from the next one,
+    // however the array happens to be aligned.
+    char pad[128 - sizeof(std::atomic<uint64_t>) - sizeof(long)];
+  };
+
+  int workers_;
+  Slot* slots_;
+};
+
+#endif // CS488_WORKQUEUE_HPP
@@ -0,0 +1,58 @@
+#ifndef CS488_ZOBRIST_HPP
+#define CS488_ZOBRIST_HPP
+
+#include <stdint.h>
+
+// Zobrist-style hashing of boards.  A board's hash is the XOR of a
+// pseudo-random key for each of its rows, so changing one row only
+// means XORing out its old key and XORing in its new one.  Keys are
+// given to whole rows rather than to single cells: a row's key is a
+// strong mix of its occupancy word and its index.  That makes moving a
+// row down during a clear cost one key instead of one per cell, and
+// means there is no key table to size for the well.  Empty rows have
+// key zero, so only the rows of the stack ever contribute.
+
+// The splitmix64 finaliser.
+inline uint64_t zobristMix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// The key of row r when its occupancy word is mask.
+inline uint64_t zobristRow(uint64_t r, uint64_t mask)
+{
+  if(mask == 0) {
+    return 0;
+  }
+  return zobristMix(mask ^ zobristMix(r + 0x9e3779b97f4a7c15ull));
+}
+
+// The index word k of row r is keyed under.  Word 0 is keyed as the
+// row itself, so a row of one word has the same key as above.
+inline uint64_t zobristWord(int r, int k)
+{
+  return uint64_t(r) + (uint64_t(k) << 32);
+}
+
+// The key of row r when it is several occupancy words long: the XOR of
+// its words' keys.
+inline uint64_t zobristRow(int r, const uint64_t* row, int words)
+{
+  uint64_t key = 0;
+  for(int k = 0; k < words; ++k) {
+    key ^= zobristRow(zobristWord(r, k), row[k]);
+  }
+  return key;
+}
+
+// The key of a falling piece in the given orientation at (x,y).
+inline uint64_t zobristPiece(int id, int rotation, int x, int y)
+{
+  uint64_t state = (uint64_t(id * 4 + rotation) << 32) |
+                   (uint64_t(x & 0xffff) << 16) | uint64_t(y & 0xffff);
+  return zobristMix(state ^ 0xd6e8feb86659fd93ull);
+}
+
+#endif // CS488_ZOBRIST_HPP